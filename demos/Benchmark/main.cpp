@@ -0,0 +1,62 @@
+#include "EMI/EMI.h"
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// Measures the cost of copying object references in scripts. Calls are synchronous so each
+// thread runs its own calls. Objects made by the call are counted on the owner path,
+// objects made by setup are counted on the shared path by every other thread.
+// Times are wall time divided by the iterations of one thread. The shared column makes every
+// thread update the same counts atomically, so it grows with the thread count.
+
+constexpr int Iterations = 200000;
+constexpr int Rounds = 5;
+
+double run(EMI::FunctionHandle& fn, int threads)
+{
+	double best = 0.0;
+	for (int round = 0; round < Rounds; round++) {
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> pool;
+		for (int i = 0; i < threads; i++) {
+			pool.emplace_back([&fn]() { fn((double)Iterations).get<double>(); });
+		}
+		for (auto& t : pool) {
+			t.join();
+		}
+		std::chrono::duration<double, std::nano> time = std::chrono::steady_clock::now() - start;
+		double perIteration = time.count() / Iterations;
+		best = round == 0 ? perIteration : std::min(best, perIteration);
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	const char* script = argc > 1 ? argv[1] : "Scripts/refcount.ril";
+	auto vm = EMI::CreateEnvironment();
+	if (!vm.CompileScript(script).wait()) {
+		printf("Failed to compile %s\n", script);
+		EMI::ReleaseEnvironment(vm);
+		return 1;
+	}
+
+	EMI::FunctionHandle setup = vm.GetFunctionHandle("setup");
+	EMI::FunctionHandle owned = vm.GetFunctionHandle("churnOwned");
+	EMI::FunctionHandle shared = vm.GetFunctionHandle("churnShared");
+	setup.SetSynchronous(true);
+	owned.SetSynchronous(true);
+	shared.SetSynchronous(true);
+	setup();
+
+	printf("%-10s %8s %14s %14s\n", "", "threads", "owned ns/it", "shared ns/it");
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+		printf("%-10s %8u %14.1f %14.1f\n", threads == 1 ? "single" : "parallel", threads, run(owned, threads), run(shared, threads));
+	}
+
+	EMI::ReleaseEnvironment(vm);
+	return 0;
+}
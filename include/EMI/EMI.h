@@ -16,6 +16,7 @@
 #include <string>
 #include <cstring>
 #include <functional>
+#include <tuple>
 #include "Value.h"
 
 #ifndef _MSC_VER
@@ -55,35 +56,72 @@ namespace EMI
 		VMHandle* vm = nullptr;
 	};
 	
+	// Discards the result of a call if the VM still exists
+	CORE_API void _internal_discard(unsigned int vm, size_t handle);
+
+	// Owns the result of a call. Destroying the handle before get() discards the result,
+	// so handles can be moved but not copied. A handle may outlive its VM, get() may not
 	class ValueHandle
 	{
 		size_t id = 0;
 		VMHandle* vm = nullptr;
+		// Index of the VM, the handle is discarded through it
+		unsigned int owner = 0;
 		InternalValue cached;
 
 	public:
-		operator size_t() {
+		operator size_t() const {
 			return id;
 		}
 
+		// Waits for the call to finish, the result can only be taken once
 		template<typename T>
 		T get();
 
-		explicit ValueHandle(size_t in, VMHandle* handle) {
+		// True once get() would not block
+		bool ready();
+
+		explicit ValueHandle(size_t in, VMHandle* handle, unsigned int index) {
 			id = in;
 			vm = handle;
+			owner = index;
+		}
+		// Result of a synchronous call, already available
+		explicit ValueHandle(const InternalValue& value) {
+			cached = value;
+		}
+
+		ValueHandle(const ValueHandle&) = delete;
+		ValueHandle& operator=(const ValueHandle&) = delete;
+		ValueHandle(ValueHandle&& other) noexcept : id(other.id), vm(other.vm), owner(other.owner), cached(other.cached) {
+			other.vm = nullptr;
 		}
+		ValueHandle& operator=(ValueHandle&& other) noexcept;
+		~ValueHandle();
 	};
 
 	class FunctionHandle
 	{
 		void* id = 0;
 		VMHandle* vm = nullptr;
+		size_t budget = (size_t)-1;
+		bool synchronous = false;
 
 	public:
+		static constexpr size_t DefaultBudget = (size_t)-1;
+
 		template<typename ...Args> requires (std::is_convertible_v<Args, InternalValue> && ...)
 		ValueHandle operator()(Args... args);
 
+		// Instructions a call may run before it is requeued behind other calls, 0 runs calls until they finish
+		FunctionHandle& SetInstructionBudget(size_t count) { budget = count; return *this; }
+		size_t GetInstructionBudget() const { return budget; }
+
+		// Synchronous calls run on the calling thread and have finished when the call returns.
+		// The instruction budget does not apply and the debugger does not stop them.
+		FunctionHandle& SetSynchronous(bool value) { synchronous = value; return *this; }
+		bool IsSynchronous() const { return synchronous; }
+
 		operator void*() {
 			return id;
 		}
@@ -226,13 +264,26 @@ namespace EMI
 		FunctionHandle GetFunctionHandle(const char* name);
 
 		ValueHandle _internal_call(FunctionHandle handle, size_t count, InternalValue* args);
+		// Calls the function count times, args holds the argCount arguments of each call one after another.
+		// The calls are split between the runners, returns once all have finished with their results in results.
+		// The instruction budget does not apply to batched calls.
+		bool CallBatch(FunctionHandle handle, size_t argCount, size_t count, const InternalValue* args, InternalValue* results);
 		bool _internal_wait(void*);
 
-		InternalValue GetReturn(ValueHandle handle);
+		InternalValue GetReturn(const ValueHandle& handle);
+		bool IsReturnReady(const ValueHandle& handle);
+		// Resumes the scripts waiting in wait(name), value is returned from their wait calls.
+		// Returns the number of scripts resumed.
+		size_t SignalEvent(const char* name, InternalValue value = {});
 
 		bool ExportVM(const char* path, const ExportOptions& options = {});
 
 		void Interrupt();
+		// Default instruction budget for calls, 0 runs calls until they finish
+		void SetInstructionBudget(size_t count);
+		// Garbage is swept in slices of at most sliceSize objects, one slice every allocations allocations.
+		// Smaller slices shorten pauses, sweeping more often keeps memory use lower. Shared by all VMs.
+		void SetCollectorPacing(size_t allocations, size_t sliceSize);
 
 		void ReleaseVM();
 
@@ -273,12 +324,43 @@ namespace EMI
 		return cached.as<T>();
 	}
 
+	inline bool ValueHandle::ready() {
+		return !vm || vm->IsReturnReady(*this);
+	}
+
+	inline ValueHandle& ValueHandle::operator=(ValueHandle&& other) noexcept {
+		if (this == &other) return *this;
+		if (vm) _internal_discard(owner, id);
+		id = other.id;
+		vm = other.vm;
+		owner = other.owner;
+		cached = other.cached;
+		other.vm = nullptr;
+		return *this;
+	}
+
+	inline ValueHandle::~ValueHandle() {
+		if (vm) _internal_discard(owner, id);
+	}
+
 	template<typename ...Args> requires (std::is_convertible_v<Args, InternalValue> && ...)
 		ValueHandle CallFunction(VMHandle* vm, FunctionHandle handle, Args... args) {
 		std::vector<InternalValue> params = { InternalValue(args)... };
 		return vm->_internal_call(handle, params.size(), params.data());
 	}
 
+	// One call for each tuple, results is resized to hold the result of each call
+	template<typename ...Args> requires (std::is_convertible_v<Args, InternalValue> && ...)
+		bool CallBatch(VMHandle* vm, FunctionHandle handle, const std::vector<std::tuple<Args...>>& args, std::vector<InternalValue>& results) {
+		std::vector<InternalValue> params;
+		params.reserve(args.size() * sizeof...(Args));
+		for (const auto& row : args) {
+			std::apply([&params](const Args&... values) { (params.emplace_back(values), ...); }, row);
+		}
+		results.resize(args.size());
+		return vm->CallBatch(handle, sizeof...(Args), args.size(), params.data(), results.data());
+	}
+
 	template<typename ...Args> requires (std::is_convertible_v<Args, InternalValue> && ...)
 		ValueHandle FunctionHandle::operator()(Args... args) {
 		return CallFunction(vm, *this, args...);
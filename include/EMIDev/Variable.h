@@ -23,8 +23,11 @@ https://craftinginterpreters.com/optimization.html#nan-boxing
 #define TRUE_VAL		(uint64_t)(QNAN | TAG_TRUE)
 #define BOOL_VAL(b)		((b) ? TRUE_VAL : FALSE_VAL)
 #define OBJ_VAL(obj)	(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+#define TAG_MASK		((uint64_t)0x0003000000000000)
+#define TAG_INT			((uint64_t)0x0001000000000000)
+#define INT_VAL(i)		(QNAN | TAG_INT | (uint64_t)(uint32_t)(i))
 
-// @todo: Maybe int type too?
+// Integers are boxed separately but are still numbers to the language
 enum class VariableType
 {
 	Undefined,
@@ -48,8 +51,7 @@ public:
 	Variable(const Variable&);
 	Variable(Variable&&) noexcept;
 	Variable(int v) {
-		double val = static_cast<double>(v);
-		memcpy(&value, &val, sizeof(value));
+		value = INT_VAL(v);
 	}
 	Variable(double v);
 	Variable(Object* ptr);
@@ -64,8 +66,14 @@ public:
 	void setUndefined();
 
 	inline bool isNumber() const {
+		return isDouble() || isInt();
+	}
+	inline bool isDouble() const {
 		return (((value)&QNAN) != QNAN);
 	}
+	inline bool isInt() const {
+		return ((value) & (SIGN_BIT | QNAN | TAG_MASK)) == (QNAN | TAG_INT);
+	}
 	inline bool isUndefined() const {
 		return value == NIL_VAL;
 	}
@@ -88,11 +96,16 @@ public:
 
 	template<typename T> requires (std::is_convertible_v<T, double>)
 	T as() const {
+		if (isInt()) return static_cast<T>(asInt());
 		double num;
 		memcpy(&num, &value, sizeof(num));
 		return static_cast<T>(num);
 	}
 
+	inline int32_t asInt() const {
+		return (int32_t)(uint32_t)value;
+	}
+
 	template<typename T> requires std::is_class_v<T>
 	T* as() const {
 		return ((T*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)));
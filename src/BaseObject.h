@@ -1,58 +1,168 @@
 #pragma once
 #include "EMIDev/Variable.h"
-#include <queue>
 #include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
 
+class Object;
+// Buffers a container whose count was decremented without reaching zero, see CycleCollector
+void AddCycleCandidate(Object* object);
+// Runs the hook during every collection, while no thread can change a count
+void AddCollectorHook(void(*hook)(void*), void* data);
+// Starts a collection at the next safepoint even if few candidates are buffered
+void RequestCollection();
+
+// Reference counts are biased towards the thread that created the object. The owner counts
+// with plain loads and stores, other threads use the atomic shared count. Only the sum is meaningful,
+// and only the owner can read it in one step since nobody else writes the local count. The allocator
+// lets the owner decide when an object is freed, see Allocator::Sweep. The owner is atomic since the
+// allocator reads it while the object is handed out again.
+// Immortal objects have no owner and are never written to, they live until the allocator is cleared.
 class Object
 {
 public:
 	VariableType getType() const { return Type; }
-	Object() : Type(VariableType::Undefined), RefCount(0) {};
+	Object() : Type(VariableType::Undefined), OwnerThread(CurrentThread()), LocalCount(-1), SharedCount(0), Buffered(false), Queued(false), Color(0), Trial(0), Birth(0) {};
 	virtual ~Object() {}
 
 	Object(Object&&) noexcept = delete;
 	Object & operator=(const Object&) = delete;
 	Object & operator=(Object&&) noexcept = delete;
 
+	inline void AddRef() {
+		uint32_t owner = OwnerThread.load(std::memory_order_relaxed);
+		if (owner == CurrentThread()) [[likely]] {
+			LocalCount.store(LocalCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+		else if (owner != ImmortalOwner) {
+			SharedCount.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	inline void Release() {
+		uint32_t owner = OwnerThread.load(std::memory_order_relaxed);
+		if (owner == CurrentThread()) [[likely]] {
+			LocalCount.store(LocalCount.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+		}
+		else if (owner != ImmortalOwner) {
+			SharedCount.fetch_sub(1, std::memory_order_release);
+		}
+		else {
+			return;
+		}
+		if (IsContainer() && !Buffered.load(std::memory_order_relaxed) && GetRefCount() > 0) {
+			AddCycleCandidate(this);
+		}
+	}
+
+	int GetRefCount() const {
+		return SharedCount.load(std::memory_order_acquire) + LocalCount.load(std::memory_order_relaxed);
+	}
+
+	// Also moves the bias to the calling thread
+	void SetRefCount(int count) {
+		OwnerThread.store(CurrentThread(), std::memory_order_relaxed);
+		LocalCount.store(count, std::memory_order_relaxed);
+		SharedCount.store(0, std::memory_order_relaxed);
+	}
+
+	// Must be called before the object is shared
+	void MakeImmortal() {
+		OwnerThread.store(ImmortalOwner, std::memory_order_relaxed);
+		LocalCount.store(1, std::memory_order_relaxed);
+		SharedCount.store(0, std::memory_order_relaxed);
+	}
+	bool IsImmortal() const { return OwnerThread.load(std::memory_order_relaxed) == ImmortalOwner; }
+
+	// Only containers can be part of a reference cycle
+	bool IsContainer() const { return Type == VariableType::Array || Type >= VariableType::Object; }
+	// Containers report the containers they reference
+	virtual void Trace(std::vector<Object*>&) {}
+	// Releases every reference the object holds
+	virtual void Clear() {}
+
+	static inline uint32_t CurrentThread() {
+		thread_local uint32_t id = 0;
+		if (id == 0) [[unlikely]] id = ++ThreadCounter;
+		return id;
+	}
+
 public:
 	VariableType Type;
-	int RefCount;
+
+private:
+	friend class CycleCollector;
+	template <class> friend class Allocator;
+
+	std::atomic<uint32_t> OwnerThread;
+	std::atomic<int> LocalCount;
+	std::atomic<int> SharedCount;
+	std::atomic<bool> Buffered;
+	// Waiting in the owner's pending list, guarded by the allocator lock
+	bool Queued;
+	uint8_t Color;
+	int Trial;
+	// Sweep cycle the object was handed out in, set by the allocator
+	std::atomic<uint32_t> Birth;
+
+	static constexpr uint32_t ImmortalOwner = 0;
+	static inline std::atomic<uint32_t> ThreadCounter = 0;
 };
 
+// Garbage is swept incrementally by the allocating threads. Every Pacing allocations a slice of
+// at most SliceSize objects is checked. Objects allocated during the current or previous sweep cycle
+// are skipped, they may not have been stored in a variable yet.
+// Each thread takes free objects from the pool in batches and keeps them in a local magazine,
+// only refills and sweep slices take the lock.
+// The two halves of a biased count are read at different moments by any thread but the owner, so
+// a slice only frees objects owned by the sweeping thread or by a thread that has exited. Other
+// unreferenced objects are queued to their owner, which checks them again on its next refill.
+// Owners that stop allocating never refill, once enough objects are queued a collection is requested
+// and the queued objects of every owner are checked while no count can change.
 template <class T>
 class Allocator
 {
 public:
 	Allocator() {
 		PointerList.push_back(nullptr);
+		Pacing = 16;
+		SliceSize = 64;
+		Cursor = 1;
+		Cycle = 0;
+		QueuedObjects = 0;
+		AddCollectorHook([](void* allocator) { static_cast<Allocator*>(allocator)->FreeQueued(); }, this);
 	}
 
 	template <typename ...Args>
 	T* Make(const Args&... args) {
-		std::unique_lock lk(AllocLock);
-		if (FreeList.empty()) {
-			auto obj = new T(args...);
-			PointerList.push_back(obj);
-			return obj;
+		auto& cache = Cache;
+		if (++cache.Debt >= Pacing.load(std::memory_order_relaxed) || cache.Objects.empty()) [[unlikely]] {
+			Refill(cache);
 		}
-		else {
-			auto idx = FreeList.front();
-			FreeList.pop();
-			auto& obj = PointerList[idx];
-			obj->RefCount = 0;
-			constexpr bool hasRealloc = requires(T& t) {
-				t.Realloc(args...);
-			};
-			if constexpr (hasRealloc) {
-				obj->Realloc(args...);
-			}
-			else {
-				obj->~T();
-				obj = new (obj) T(args...);
-			}
 
-			return obj;
+		T* obj = cache.Objects.back();
+		cache.Objects.pop_back();
+
+		constexpr bool hasRealloc = requires(T& t) {
+			t.Realloc(args...);
+		};
+		if constexpr (!hasRealloc) {
+			// Objects are constructed free, the sweep ignores them until the count is set below
+			obj->~T();
+			obj = new (obj) T(args...);
 		}
+
+		// The birth is published before the count leaves -1, so a concurrent sweep skips the object
+		obj->Birth.store(Cycle.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		obj->SetRefCount(0);
+
+		if constexpr (hasRealloc) {
+			obj->Realloc(args...);
+		}
+
+		return obj;
 	}
 
 	template <typename ...Args>
@@ -60,20 +170,10 @@ public:
 		return Make(*object);
 	}
 
-	void Free() {
-		std::unique_lock lk(AllocLock);
-		for (size_t i = 1; i < PointerList.size(); i++) {
-			if (PointerList[i]->RefCount == 0) {
-				PointerList[i]->RefCount = -1;
-				constexpr bool hasClear = requires(T & t) {
-					t.Clear();
-				};
-				if constexpr (hasClear) {
-					PointerList[i]->Clear();
-				}
-				FreeList.push(i);
-			}
-		}
+	// Allocations between sweep slices and the maximum number of objects checked per slice
+	void SetPacing(size_t allocations, size_t slice) {
+		Pacing.store(allocations > 0 ? allocations : 1, std::memory_order_relaxed);
+		SliceSize.store(slice > 0 ? slice : 1, std::memory_order_relaxed);
 	}
 
 	void Clear() {
@@ -82,13 +182,135 @@ public:
 			delete ptr;
 		}
 		PointerList.clear();
-		while (!FreeList.empty())
-			FreeList.pop();
+		PointerList.push_back(nullptr);
+		Cursor = 1;
+		FreeList.clear();
+		for (auto& [id, cache] : Owners) {
+			cache->Pending.clear();
+		}
 	}
 
 private:
+	static constexpr size_t MagazineSize = 32;
+	// Objects queued to other owners between collection requests
+	static constexpr size_t QueueLimit = 1024;
+
+	struct Magazine
+	{
+		std::vector<T*> Objects;
+		size_t Debt = 0;
+		// Objects owned by this thread that a sweep found unreferenced
+		std::vector<T*> Pending;
+		Allocator* Owner = nullptr;
+
+		// Objects left over by an exiting thread go back to the pool. The local counts of the objects
+		// it owns no longer change, so later sweeps can free them directly
+		~Magazine() {
+			if (Owner) {
+				std::unique_lock lk(Owner->AllocLock);
+				Owner->FreeList.insert(Owner->FreeList.end(), Objects.begin(), Objects.end());
+				for (auto obj : Pending) {
+					obj->Queued = false;
+				}
+				Owner->Owners.erase(Object::CurrentThread());
+			}
+		}
+	};
+
+	void Refill(Magazine& cache) {
+		std::unique_lock lk(AllocLock);
+		if (!cache.Owner) {
+			cache.Owner = this;
+			Owners[Object::CurrentThread()] = &cache;
+		}
+
+		uint32_t cycle = Cycle.load(std::memory_order_relaxed);
+		for (auto obj : cache.Pending) {
+			obj->Queued = false;
+			Free(obj, cycle);
+		}
+		cache.Pending.clear();
+
+		if (cache.Debt >= Pacing.load(std::memory_order_relaxed)) {
+			cache.Debt = 0;
+			Sweep(SliceSize.load(std::memory_order_relaxed));
+		}
+		if (!cache.Objects.empty()) return;
+
+		size_t count = std::min(MagazineSize, FreeList.size());
+		cache.Objects.assign(FreeList.end() - count, FreeList.end());
+		FreeList.resize(FreeList.size() - count);
+
+		// New objects start with a count of -1 so the sweep ignores them
+		for (; count < MagazineSize; count++) {
+			auto obj = new T();
+			PointerList.push_back(obj);
+			cache.Objects.push_back(obj);
+		}
+	}
+
+	// A slice stops at the end of the list so the cycle advances at most once per slice
+	void Sweep(size_t count) {
+		uint32_t cycle = Cycle.load(std::memory_order_relaxed);
+		for (; count > 0; count--) {
+			if (Cursor >= PointerList.size()) {
+				Cursor = 1;
+				Cycle.store(cycle + 1, std::memory_order_relaxed);
+				return;
+			}
+			auto obj = PointerList[Cursor++];
+			if (obj->Queued || obj->GetRefCount() != 0) continue;
+			uint32_t owner = obj->OwnerThread.load(std::memory_order_relaxed);
+			if (owner != Object::CurrentThread()) {
+				if (auto it = Owners.find(owner); it != Owners.end()) {
+					obj->Queued = true;
+					it->second->Pending.push_back(obj);
+					if (++QueuedObjects >= QueueLimit) {
+						QueuedObjects = 0;
+						RequestCollection();
+					}
+					continue;
+				}
+			}
+			Free(obj, cycle);
+		}
+	}
+
+	// Called by the collector while every thread is stopped, the counts of all owners are exact
+	void FreeQueued() {
+		std::unique_lock lk(AllocLock);
+		uint32_t cycle = Cycle.load(std::memory_order_relaxed);
+		for (auto& [id, cache] : Owners) {
+			for (auto obj : cache->Pending) {
+				obj->Queued = false;
+				Free(obj, cycle);
+			}
+			cache->Pending.clear();
+		}
+	}
+
+	// Called by the owner, for objects of exited threads or while stopped by the collector, the count read is exact
+	void Free(T* obj, uint32_t cycle) {
+		if (obj->GetRefCount() != 0) return;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (cycle - obj->Birth.load(std::memory_order_relaxed) >= 2) {
+			obj->SetRefCount(-1);
+			obj->Clear();
+			FreeList.push_back(obj);
+		}
+	}
 
 	std::mutex AllocLock;
 	std::vector<T*> PointerList;
-	std::queue<size_t> FreeList;
+	std::vector<T*> FreeList;
+	// Magazines of the live threads by thread id
+	std::unordered_map<uint32_t, Magazine*> Owners;
+	// Changed at any time by SetPacing, read by allocations without the lock
+	std::atomic<size_t> Pacing;
+	std::atomic<size_t> SliceSize;
+	size_t Cursor;
+	size_t QueuedObjects;
+	std::atomic<uint32_t> Cycle;
+
+	static inline thread_local Magazine Cache;
 };
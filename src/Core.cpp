@@ -2,9 +2,12 @@
 #include <ankerl/unordered_dense.h>
 #include "VM.h"
 #include <unordered_set>
+#include <shared_mutex>
 
 uint32_t Index = 0;
 ankerl::unordered_dense::map<uint32_t, VM*> VMs = {};
+// Results may be discarded on any thread while a VM is released
+std::shared_mutex VMLock;
 
 auto& Strings() {
 	static std::unordered_set<std::string> strs;
@@ -18,6 +21,7 @@ auto& StrMutex() {
 uint32_t CreateVM()
 {
     auto vm = new VM();
+    std::unique_lock lk(VMLock);
     uint32_t idx = ++Index;
     VMs.emplace(idx, vm);
 
@@ -26,13 +30,31 @@ uint32_t CreateVM()
 
 void ReleaseVM(uint32_t handle)
 {
-    delete VMs[handle];
-    VMs.erase(handle);
+    VM* vm = nullptr;
+    {
+        // Discards still running finish first, the VM is deleted unlocked since its runners may discard results
+        std::unique_lock lk(VMLock);
+        if (auto it = VMs.find(handle); it != VMs.end()) {
+            vm = it->second;
+            VMs.erase(it);
+        }
+    }
+    delete vm;
 }
 
 VM* GetVM(uint32_t handle)
 {
-    return VMs[handle];
+    std::shared_lock lk(VMLock);
+    auto it = VMs.find(handle);
+    return it != VMs.end() ? it->second : nullptr;
+}
+
+void DiscardVMResult(uint32_t handle, size_t result)
+{
+    std::shared_lock lk(VMLock);
+    if (auto it = VMs.find(handle); it != VMs.end()) {
+        it->second->DiscardReturnValue(result);
+    }
 }
 
 NameType::NameType() : Name(nullptr)
@@ -9,6 +9,9 @@ void ReleaseVM(uint32_t handle);
 
 class VM* GetVM(uint32_t handle);
 
+// Does nothing if the VM has been released
+void DiscardVMResult(uint32_t handle, size_t result);
+
 class NameType
 {
 private:
@@ -0,0 +1,277 @@
+#include "CycleCollector.h"
+#include <chrono>
+
+enum CycleColor : uint8_t
+{
+	Black,
+	Gray,
+	White,
+};
+
+void AddCycleCandidate(Object* object)
+{
+	GetCycleCollector().AddCandidate(object);
+}
+
+void AddCollectorHook(void(*hook)(void*), void* data)
+{
+	GetCycleCollector().AddHook(hook, data);
+}
+
+void RequestCollection()
+{
+	GetCycleCollector().Request();
+}
+
+CycleCollector& GetCycleCollector()
+{
+	static CycleCollector collector;
+	return collector;
+}
+
+CycleCollector::CycleCollector()
+{
+	Threshold = 1024;
+	BatchSize = 512;
+	Trigger = Threshold;
+	Active = 0;
+	Collecting = false;
+	Requested = false;
+}
+
+void CycleCollector::AddCandidate(Object* object)
+{
+	if (object->Buffered.exchange(true)) return;
+
+	bool full = false;
+	{
+		std::unique_lock lk(RootLock);
+		Roots.push_back(object);
+		full = Roots.size() == Trigger;
+	}
+	if (full) {
+		SignalRunners();
+	}
+}
+
+void CycleCollector::AddHook(void(*hook)(void*), void* data)
+{
+	std::unique_lock lk(RunnerLock);
+	Hooks.push_back({ hook, data });
+}
+
+void CycleCollector::Request()
+{
+	Requested = true;
+	SignalRunners();
+}
+
+void CycleCollector::SignalRunners()
+{
+	std::unique_lock lk(RunnerLock);
+	for (auto& [signals, bit] : Runners) {
+		signals->fetch_or(bit);
+	}
+}
+
+void CycleCollector::Register(std::atomic<uint8_t>* signals, uint8_t bit)
+{
+	std::unique_lock lk(RunnerLock);
+	Runners.push_back({ signals, bit });
+}
+
+void CycleCollector::Unregister(std::atomic<uint8_t>* signals)
+{
+	std::unique_lock lk(RunnerLock);
+	std::erase_if(Runners, [&](auto& runner) { return runner.first == signals; });
+}
+
+// Scopes entered by the thread, only the outermost one is counted in Active
+static thread_local int ScopeDepth = 0;
+
+void CycleCollector::Enter()
+{
+	if (ScopeDepth++ > 0) return;
+	Active.fetch_add(1);
+	if (!Collecting.load()) [[likely]] return;
+
+	std::unique_lock lk(WorldLock);
+	while (Collecting) {
+		Active.fetch_sub(1);
+		WorldNotify.notify_all();
+		WorldNotify.wait(lk, [&]() { return !Collecting.load(); });
+		Active.fetch_add(1);
+	}
+}
+
+void CycleCollector::Leave()
+{
+	if (--ScopeDepth > 0) return;
+	if (Active.fetch_sub(1) == 1 && Collecting.load()) {
+		std::unique_lock lk(WorldLock);
+		WorldNotify.notify_all();
+	}
+}
+
+void CycleCollector::Collect()
+{
+	{
+		std::unique_lock lk(RootLock);
+		if (Roots.size() < Trigger && !Requested.load()) return;
+	}
+	{
+		std::unique_lock lk(WorldLock);
+		// Another runner is collecting, Enter waits for it
+		if (Collecting) return;
+		Collecting = true;
+	}
+	SignalRunners();
+
+	// The collecting thread does not touch any counts until the pass is over
+	bool inScope = ScopeDepth > 0;
+	if (inScope) Active.fetch_sub(1);
+
+	// Threads blocked in host calls or the debugger cannot be stopped, try again later
+	bool stopped = false;
+	{
+		std::unique_lock lk(WorldLock);
+		stopped = WorldNotify.wait_for(lk, std::chrono::milliseconds(10), [&]() { return Active.load() == 0; });
+	}
+
+	bool pending = false;
+	if (stopped) {
+		std::vector<Object*> roots;
+		{
+			std::unique_lock lk(RootLock);
+			size_t count = std::min(BatchSize, Roots.size());
+			roots.assign(Roots.end() - count, Roots.end());
+			Roots.resize(Roots.size() - count);
+			Trigger = Threshold;
+			pending = Roots.size() >= Trigger;
+		}
+		ProcessRoots(roots);
+
+		Requested = false;
+		std::vector<std::pair<void(*)(void*), void*>> hooks;
+		{
+			std::unique_lock lk(RunnerLock);
+			hooks = Hooks;
+		}
+		for (auto& [hook, data] : hooks) {
+			hook(data);
+		}
+	}
+	else {
+		// Counts may still change, the pass is abandoned and the roots stay buffered
+		std::unique_lock lk(RootLock);
+		Trigger = Roots.size() + Threshold;
+	}
+
+	if (inScope) Active.fetch_add(1);
+	{
+		std::unique_lock lk(WorldLock);
+		Collecting = false;
+	}
+	WorldNotify.notify_all();
+
+	if (pending) {
+		SignalRunners();
+	}
+}
+
+void CycleCollector::ProcessRoots(std::vector<Object*>& roots)
+{
+	for (auto root : roots) {
+		root->Buffered = false;
+	}
+	// Freed or reused objects may still be buffered
+	std::erase_if(roots, [](Object* root) { return root->GetRefCount() <= 0 || !root->IsContainer(); });
+
+	for (auto root : roots) {
+		if (root->Color != Gray) MarkGray(root);
+	}
+	for (auto root : roots) {
+		Scan(root);
+	}
+
+	std::vector<Object*> garbage;
+	for (auto object : WhiteList) {
+		if (object->Color == White) {
+			object->Color = Black;
+			garbage.push_back(object);
+		}
+	}
+	WhiteList.clear();
+
+	// Breaking the references lets the counts reach zero, the allocators reclaim the objects
+	for (auto object : garbage) {
+		object->Clear();
+	}
+}
+
+// Trial counts start from the real count and lose every reference coming from inside the subgraph
+void CycleCollector::MarkGray(Object* root)
+{
+	root->Color = Gray;
+	root->Trial = root->GetRefCount();
+	Stack.push_back(root);
+	while (!Stack.empty()) {
+		auto object = Stack.back();
+		Stack.pop_back();
+
+		Children.clear();
+		object->Trace(Children);
+		for (auto child : Children) {
+			if (child->Color != Gray) {
+				child->Color = Gray;
+				child->Trial = child->GetRefCount();
+				Stack.push_back(child);
+			}
+			child->Trial--;
+		}
+	}
+}
+
+void CycleCollector::Scan(Object* root)
+{
+	Stack.push_back(root);
+	while (!Stack.empty()) {
+		auto object = Stack.back();
+		Stack.pop_back();
+		if (object->Color != Gray) continue;
+
+		if (object->Trial > 0) {
+			ScanBlack(object);
+			continue;
+		}
+
+		object->Color = White;
+		WhiteList.push_back(object);
+		Children.clear();
+		object->Trace(Children);
+		for (auto child : Children) {
+			if (child->Color == Gray) Stack.push_back(child);
+		}
+	}
+}
+
+// Everything reachable from an externally referenced object is alive
+void CycleCollector::ScanBlack(Object* root)
+{
+	std::vector<Object*> stack;
+	root->Color = Black;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		auto object = stack.back();
+		stack.pop_back();
+
+		Children.clear();
+		object->Trace(Children);
+		for (auto child : Children) {
+			if (child->Color != Black) {
+				child->Color = Black;
+				stack.push_back(child);
+			}
+		}
+	}
+}
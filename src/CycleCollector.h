@@ -0,0 +1,78 @@
+#pragma once
+#include "BaseObject.h"
+#include <condition_variable>
+
+/**
+
+Trial deletion cycle collector, Bacon & Rajan: Concurrent Cycle Collection in Reference Counted Systems
+
+Containers whose count is decremented to a non-zero value are buffered as candidate roots. Once enough
+candidates exist the runners are stopped at their next safepoint and a batch of roots is processed.
+Every thread that reads or writes reference counts, runners and host threads calling into the VM, does so
+inside a CollectorScope. A batch is only processed once no thread is inside a scope, if the world cannot be
+stopped in time the batch is left for a later collection.
+Trial counts are kept separate from the real counts, garbage cycles are broken by clearing the
+containers and the allocators sweep them once the counts reach zero. The allocators also free the objects
+queued to their owners while the world is stopped, see Allocator::FreeQueued.
+
+*/
+class CycleCollector
+{
+public:
+	CycleCollector();
+
+	void AddCandidate(Object* object);
+	void AddHook(void(*hook)(void*), void* data);
+	// Collects at the next safepoint even if there are not enough candidates
+	void Request();
+
+	// Runners register their signal word, the collect bit is raised when a collection is needed
+	void Register(std::atomic<uint8_t>* signals, uint8_t bit);
+	void Unregister(std::atomic<uint8_t>* signals);
+
+	// Wraps code changing reference counts, waits while a collection is running. Calls can nest on a thread
+	void Enter();
+	void Leave();
+
+	// Called by a runner at a safepoint, processes one batch of roots once every other thread has left its scope
+	void Collect();
+
+private:
+	void ProcessRoots(std::vector<Object*>& roots);
+	void SignalRunners();
+	void MarkGray(Object* root);
+	void Scan(Object* root);
+	void ScanBlack(Object* root);
+
+	std::mutex RootLock;
+	std::vector<Object*> Roots;
+	size_t Threshold;
+	size_t BatchSize;
+	// Candidate count that starts the next collection, raised when runners could not be stopped
+	size_t Trigger;
+
+	std::mutex RunnerLock;
+	std::vector<std::pair<std::atomic<uint8_t>*, uint8_t>> Runners;
+	std::vector<std::pair<void(*)(void*), void*>> Hooks;
+	std::atomic<bool> Requested;
+
+	std::mutex WorldLock;
+	std::condition_variable WorldNotify;
+	std::atomic<int> Active;
+	std::atomic<bool> Collecting;
+
+	std::vector<Object*> Stack;
+	std::vector<Object*> Children;
+	std::vector<Object*> WhiteList;
+};
+
+CycleCollector& GetCycleCollector();
+
+class CollectorScope
+{
+public:
+	CollectorScope() { GetCycleCollector().Enter(); }
+	~CollectorScope() { GetCycleCollector().Leave(); }
+	CollectorScope(const CollectorScope&) = delete;
+	CollectorScope& operator=(const CollectorScope&) = delete;
+};
@@ -10,7 +10,7 @@
 #endif
 
 constexpr uint16_t EMI_VERSION = 10100; // Major 01 Minor 01 Patch 00;
-constexpr uint8_t FORMAT_VERSION = 1; // Major 01 Minor 01 Patch 00;
+constexpr uint8_t FORMAT_VERSION = 2; // 2: CallSymbol data words carry a CallTable index
 
 inline LogService& gCompileLogger()
 {
@@ -147,8 +147,16 @@ FunctionHandle EMI::VMHandle::GetFunctionHandle(const char* name)
 ValueHandle EMI::VMHandle::_internal_call(FunctionHandle handle, size_t count, InternalValue* args)
 {
 	const std::span<InternalValue> s(args, count);
-	size_t out = ((VM*)Vm)->CallFunction(handle, s);
-	return ValueHandle{ out, this };
+	if (handle.IsSynchronous()) {
+		return ValueHandle{ ((VM*)Vm)->CallFunctionInline(handle, s) };
+	}
+	size_t out = ((VM*)Vm)->CallFunction(handle, s, handle.GetInstructionBudget());
+	return ValueHandle{ out, this, Index };
+}
+
+bool EMI::VMHandle::CallBatch(FunctionHandle handle, size_t argCount, size_t count, const InternalValue* args, InternalValue* results)
+{
+	return ((VM*)Vm)->CallBatch(handle, argCount, count, args, results);
 }
 
 bool EMI::VMHandle::_internal_wait(void* ptr)
@@ -156,11 +164,27 @@ bool EMI::VMHandle::_internal_wait(void* ptr)
 	return ((VM*)Vm)->WaitForResult(ptr);
 }
 
-InternalValue EMI::VMHandle::GetReturn(ValueHandle handle)
+InternalValue EMI::VMHandle::GetReturn(const ValueHandle& handle)
 {
 	return ((VM*)Vm)->GetReturnValue(handle);
 }
 
+bool EMI::VMHandle::IsReturnReady(const ValueHandle& handle)
+{
+	return ((VM*)Vm)->IsReturnReady(handle);
+}
+
+void EMI::_internal_discard(unsigned int vm, size_t handle)
+{
+	// Handles are discarded when they go out of scope, the VM may already be released
+	DiscardVMResult(vm, handle);
+}
+
+size_t EMI::VMHandle::SignalEvent(const char* name, InternalValue value)
+{
+	return ((VM*)Vm)->SignalEvent(name, value);
+}
+
 bool EMI::VMHandle::ExportVM(const char* path, const ExportOptions& options)
 {
 	return ((VM*)Vm)->Export(path, options);
@@ -171,6 +195,16 @@ void EMI::VMHandle::Interrupt()
 	return ((VM*)Vm)->Interrupt();
 }
 
+void EMI::VMHandle::SetInstructionBudget(size_t count)
+{
+	((VM*)Vm)->SetInstructionBudget(count);
+}
+
+void EMI::VMHandle::SetCollectorPacing(size_t allocations, size_t sliceSize)
+{
+	((VM*)Vm)->SetCollectorPacing(allocations, sliceSize);
+}
+
 void EMI::VMHandle::ReleaseVM()
 {
 	::ReleaseVM(Index);
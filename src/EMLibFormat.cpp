@@ -92,22 +92,25 @@ void WriteFunction(std::ostream& out, const ScriptFunction* fnd) {
 		WriteArray(out, name.GetPaths(), [](std::ostream& out, const PathType& path) { WriteString(out, path.toString()); });
 		});
 
-	WriteArray(out, fnd->Bytecode);
+	WriteArray(out, fnd->GetOriginalBytecode());
 }
 
-void ReadFunction(std::istream& instream, ScriptFunction* fnd) {
+void ReadFunction(std::istream& instream, ScriptFunction* fnd, uint8_t format) {
 	ReadValue(instream, fnd->ArgCount);
 	ReadValue(instream, fnd->RegisterCount);
 	ReadValue(instream, fnd->IsPublic);
 
 	ReadArray(instream, fnd->StringTable, [](std::istream& in, Variable& var) {
 		std::string str = ReadString(in);
-		var = String::GetAllocator()->Make(str.c_str());
+		auto literal = String::GetAllocator()->Make(str.c_str());
+		literal->MakeLiteral();
+		var = literal;
 		});
 
 	std::vector<double> nums;
 	ReadArray(instream, nums);
 	fnd->NumberTable.insert(nums.begin(), nums.end());
+	fnd->BuildNumberConstants();
 
 	std::vector<std::pair<int, int>> debug;
 	ReadArray(instream, debug);
@@ -132,11 +135,21 @@ void ReadFunction(std::istream& instream, ScriptFunction* fnd) {
 		});
 
 	fnd->FunctionTable.resize(fnd->FunctionTableSymbols.size(), nullptr);
-	fnd->PropertyTable.resize(fnd->PropertyTableSymbols.size(), -1);
+	fnd->PropertyTable.resize(fnd->PropertyTableSymbols.size());
 	fnd->TypeTable.resize(fnd->TypeTableSymbols.size(), VariableType::Undefined);
 	fnd->GlobalTable.resize(fnd->GlobalTableSymbols.size(), nullptr);
 
 	ReadArray(instream, fnd->Bytecode);
+
+	for (size_t i = 0; i + 1 < fnd->Bytecode.size(); i += InstructionWidth(reinterpret_cast<Instruction*>(&fnd->Bytecode[i])->code)) {
+		auto ins = reinterpret_cast<Instruction*>(&fnd->Bytecode[i]);
+		if (ins->code == OpCodes::CallSymbol || ins->code == OpCodes::TailCallSymbol) {
+			auto data = reinterpret_cast<Instruction*>(&fnd->Bytecode[i + 1]);
+			// Format 1 left the param unset, give every call site its own entry
+			if (format < 2) data->param = (uint16_t)fnd->CallTable.size();
+			fnd->CallTable.resize(std::max(fnd->CallTable.size(), (size_t)data->param + 1));
+		}
+	}
 }
 
 bool Library::Decode(std::istream& instream, SymbolTable& table, ScriptFunction*& init)
@@ -155,7 +168,8 @@ bool Library::Decode(std::istream& instream, SymbolTable& table, ScriptFunction*
 
 	switch (format)
 	{
-	case 1: {
+	case 1:
+	case 2: {
 		uint16_t datasize;
 		ReadValue(instream, datasize);
 
@@ -220,7 +234,7 @@ bool Library::Decode(std::istream& instream, SymbolTable& table, ScriptFunction*
 						auto fnd = new ScriptFunction();
 						fn->Local = fnd;
 
-						ReadFunction(in, fnd);
+						ReadFunction(in, fnd, format);
 
 					} break;
 					default:
@@ -238,7 +252,7 @@ bool Library::Decode(std::istream& instream, SymbolTable& table, ScriptFunction*
 
 		init = new ScriptFunction();
 
-		ReadFunction(instream, init);
+		ReadFunction(instream, init, format);
 
 	} break;
 	default:
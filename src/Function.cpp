@@ -1,4 +1,5 @@
 #include "Function.h"
+#include "Helpers.h"
 
 // @todo: Fix this, doesn't work with sets!!!
 void ScriptFunction::Append(ScriptFunction fn)
@@ -8,6 +9,11 @@ void ScriptFunction::Append(ScriptFunction fn)
 		return;
 	}
 
+	auto breakpoints = std::move(fn.Breakpoints);
+	for (auto& [idx, original] : breakpoints) {
+		fn.Bytecode[idx] = original;
+	}
+
 	for (size_t i = 0; i < fn.Bytecode.size(); i++) {
 		auto ins = reinterpret_cast<Instruction*>(&fn.Bytecode[i]);
 
@@ -16,7 +22,9 @@ void ScriptFunction::Append(ScriptFunction fn)
 		case OpCodes::LoadString: {
 			ins->param += (uint16_t)StringTable.size();
 		} break;
-		case OpCodes::LoadNumber: {
+		case OpCodes::LoadNumber:
+		case OpCodes::LoadNumberNumAdd:
+		case OpCodes::LoadNumberNumSub: {
 			ins->param += (uint16_t)NumberTable.size();
 		} break;
 		case OpCodes::LoadSymbol: {
@@ -25,7 +33,8 @@ void ScriptFunction::Append(ScriptFunction fn)
 		case OpCodes::StoreSymbol: {
 			ins->param += (uint16_t)GlobalTableSymbols.size();
 		} break;
-		case OpCodes::LoadProperty: {
+		case OpCodes::LoadProperty:
+		case OpCodes::LoadPropertyCallSymbol: {
 			ins = reinterpret_cast<Instruction*>(&fn.Bytecode[++i]);
 			ins->param += (uint16_t)PropertyTableSymbols.size();
 		} break;
@@ -43,10 +52,16 @@ void ScriptFunction::Append(ScriptFunction fn)
 			ins = reinterpret_cast<Instruction*>(&fn.Bytecode[++i]);
 			ins->param += (uint16_t)TypeTableSymbols.size();
 		} break;
-		case OpCodes::CallFunction: {
+		case OpCodes::CallFunction:
+		case OpCodes::TailCallFunction: {
 			ins = reinterpret_cast<Instruction*>(&fn.Bytecode[++i]);
 			ins->data += (uint16_t)FunctionTableSymbols.size();
 		} break;
+		case OpCodes::CallSymbol:
+		case OpCodes::TailCallSymbol: {
+			ins = reinterpret_cast<Instruction*>(&fn.Bytecode[++i]);
+			ins->param += (uint16_t)CallTable.size();
+		} break;
 		default:
 			break;
 		}
@@ -63,9 +78,117 @@ void ScriptFunction::Append(ScriptFunction fn)
 	GlobalTable.resize(GlobalTableSymbols.size());
 	PropertyTable.resize(PropertyTableSymbols.size());
 	TypeTable.resize(TypeTableSymbols.size());
+	CallTable.resize(CallTable.size() + fn.CallTable.size());
 
 	RegisterCount = std::max(RegisterCount, fn.RegisterCount);
+	size_t offset = Bytecode.size();
 	Bytecode.insert(Bytecode.end(), fn.Bytecode.begin(), fn.Bytecode.end());
+
+	for (auto& [idx, original] : breakpoints) {
+		SetBreakpoint(offset + idx);
+	}
+	BuildNumberConstants();
+}
+
+void ScriptFunction::BuildNumberConstants()
+{
+	NumberConstants.clear();
+	NumberConstants.reserve(NumberTable.size());
+	for (double value : NumberTable.values()) {
+		NumberConstants.push_back(narrowNumber(value));
+	}
+}
+
+// First instruction of a fused pair, or the code itself when it is not fused
+static OpCodes UnfusedCode(OpCodes code)
+{
+	switch (code)
+	{
+	case OpCodes::LessJumpNeg: return OpCodes::Less;
+	case OpCodes::LessEqualJumpNeg: return OpCodes::LessEqual;
+	case OpCodes::GreaterJumpNeg: return OpCodes::Greater;
+	case OpCodes::GreaterEqualJumpNeg: return OpCodes::GreaterEqual;
+	case OpCodes::LoadNumberNumAdd:
+	case OpCodes::LoadNumberNumSub: return OpCodes::LoadNumber;
+	case OpCodes::LoadImmediateNumAdd:
+	case OpCodes::LoadImmediateNumSub: return OpCodes::LoadImmediate;
+	case OpCodes::LoadPropertyCallSymbol: return OpCodes::LoadProperty;
+	case OpCodes::CopyCallFunction: return OpCodes::Copy;
+	default: return code;
+	}
+}
+
+void ScriptFunction::Unfuse(size_t instruction)
+{
+	size_t head = 0;
+	Instruction op;
+	for (size_t i = 0; i < instruction; i += InstructionWidth(op.code)) {
+		head = i;
+		auto it = Breakpoints.find((uint32_t)i);
+		op.data = it != Breakpoints.end() ? it->second : LoadCodeWord(&Bytecode[i]);
+	}
+	if (instruction == 0 || head + InstructionWidth(op.code) != instruction) return;
+
+	Instruction split = op;
+	split.code = UnfusedCode(op.code);
+	if (split.code == op.code) return;
+
+	// A head with its own breakpoint keeps the break, only the word it restores changes
+	if (auto it = Breakpoints.find((uint32_t)head); it != Breakpoints.end()) {
+		it->second = split.data;
+	}
+	else {
+		// Fused codes are never quickened, the word still holds the fused head
+		ReplaceCodeWord(&Bytecode[head], op.data, split.data);
+	}
+}
+
+bool ScriptFunction::SetBreakpoint(size_t instruction)
+{
+	if (instruction >= Bytecode.size()) return false;
+	if (Breakpoints.contains((uint32_t)instruction)) return true;
+
+	// A pair fused at compile time would skip a break on its second instruction
+	Unfuse(instruction);
+
+	Instruction op;
+	op.code = OpCodes::Break;
+	// The original is recorded before runners can reach the break. They may quicken the instruction
+	// meanwhile, the word actually replaced is the one restored later
+	uint32_t original = LoadCodeWord(&Bytecode[instruction]);
+	auto& saved = Breakpoints.emplace((uint32_t)instruction, original).first->second;
+	while (!ReplaceCodeWord(&Bytecode[instruction], original, op.data)) {
+		original = LoadCodeWord(&Bytecode[instruction]);
+		saved = original;
+	}
+	return true;
+}
+
+bool ScriptFunction::ClearBreakpoint(size_t instruction)
+{
+	if (auto it = Breakpoints.find((uint32_t)instruction); it != Breakpoints.end()) {
+		StoreCodeWord(&Bytecode[instruction], it->second);
+		Breakpoints.erase(it);
+		return true;
+	}
+	return false;
+}
+
+uint32_t ScriptFunction::GetOriginalInstruction(size_t instruction) const
+{
+	if (auto it = Breakpoints.find((uint32_t)instruction); it != Breakpoints.end()) {
+		return it->second;
+	}
+	return Instruction().data;
+}
+
+std::vector<uint32_t> ScriptFunction::GetOriginalBytecode() const
+{
+	std::vector<uint32_t> code = Bytecode;
+	for (auto& [idx, original] : Breakpoints) {
+		code[idx] = original;
+	}
+	return code;
 }
 
 FunctionSymbol::~FunctionSymbol()
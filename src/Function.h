@@ -8,6 +8,7 @@
 #include "EMI/EMI.h"
 #include "Intrinsic.h"
 #include <map>
+#include <atomic>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -45,6 +46,44 @@ union Instruction
 #pragma pack(pop)
 #endif
 
+// Number of bytecode words used by the instruction, the extra word holds data
+inline size_t InstructionWidth(OpCodes code)
+{
+	switch (code)
+	{
+	case OpCodes::LoadProperty:
+	case OpCodes::StoreProperty:
+	case OpCodes::CallFunction:
+	case OpCodes::CallSymbol:
+	case OpCodes::InitObject:
+	case OpCodes::RangeForVar:
+	case OpCodes::LoadPropertyCallSymbol:
+	case OpCodes::TailCallFunction:
+	case OpCodes::TailCallSymbol:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+// Instruction words are rewritten by quickening and breakpoints while other runners execute the function,
+// they are always read and written whole
+inline uint32_t LoadCodeWord(const uint32_t* word)
+{
+	return std::atomic_ref<uint32_t>(const_cast<uint32_t&>(*word)).load(std::memory_order_relaxed);
+}
+
+inline void StoreCodeWord(uint32_t* word, uint32_t value)
+{
+	std::atomic_ref<uint32_t>(*word).store(value, std::memory_order_relaxed);
+}
+
+// Replaces the word only if it still holds expected
+inline bool ReplaceCodeWord(uint32_t* word, uint32_t expected, uint32_t value)
+{
+	return std::atomic_ref<uint32_t>(*word).compare_exchange_strong(expected, value, std::memory_order_relaxed);
+}
+
 struct ScopeType
 {
 	// @todo: NameType might be enough?
@@ -118,16 +157,99 @@ struct FunctionTable
 	}
 };
 
+// Field indices resolved for one property name, keyed by object type.
+// Names seen on more types than fit use the ObjectManager lookup every time.
+// Runners share the cache, an entry holds the type in the high half and the index in the low half
+// so it is published with a single store. An empty entry is 0.
+struct PropertyCache
+{
+	static constexpr size_t Size = 4;
+
+	std::atomic<uint32_t> Entries[Size] = {};
+
+	PropertyCache() = default;
+	PropertyCache(const PropertyCache& other) {
+		for (size_t i = 0; i < Size; i++) {
+			Entries[i].store(other.Entries[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+		}
+	}
+
+	bool Find(VariableType type, uint16_t& index) const {
+		for (auto& entry : Entries) {
+			uint32_t value = entry.load(std::memory_order_acquire);
+			if (value == 0) return false;
+			if ((value >> 16) == static_cast<uint16_t>(type)) {
+				index = static_cast<uint16_t>(value);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void Add(VariableType type, uint16_t index) {
+		uint32_t value = (static_cast<uint32_t>(static_cast<uint16_t>(type)) << 16) | index;
+		for (auto& entry : Entries) {
+			uint32_t expected = 0;
+			if (entry.compare_exchange_strong(expected, value, std::memory_order_release, std::memory_order_acquire)) return;
+			// Another runner added the same type
+			if ((expected >> 16) == static_cast<uint16_t>(type)) return;
+		}
+	}
+};
+
+// Last function resolved by a CallSymbol site. Runners share the entry, so it is published as a
+// unit with a sequence count that is odd while a runner writes it. Readers that see the count
+// change treat the entry as a miss.
+struct CallCache
+{
+	std::atomic<uint32_t> Sequence = 0;
+	std::atomic<FunctionTable*> Table = nullptr;
+	std::atomic<FunctionSymbol*> Symbol = nullptr;
+	// Signature has no typed arguments, type checks can be skipped
+	std::atomic<bool> Untyped = false;
+
+	CallCache() = default;
+	CallCache(const CallCache& other) {
+		Table.store(other.Table.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		Symbol.store(other.Symbol.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		Untyped.store(other.Untyped.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	bool Find(FunctionTable* table, FunctionSymbol*& symbol, bool& untyped) const {
+		uint32_t sequence = Sequence.load(std::memory_order_acquire);
+		if (sequence & 1) return false;
+		if (Table.load(std::memory_order_relaxed) != table) return false;
+		symbol = Symbol.load(std::memory_order_relaxed);
+		untyped = Untyped.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return Sequence.load(std::memory_order_relaxed) == sequence;
+	}
+
+	// Skipped if another runner is writing the entry, the next miss tries again
+	void Store(FunctionTable* table, FunctionSymbol* symbol, bool untyped) {
+		uint32_t sequence = Sequence.load(std::memory_order_relaxed);
+		if ((sequence & 1) || !Sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_relaxed)) return;
+		std::atomic_thread_fence(std::memory_order_release);
+		Table.store(table, std::memory_order_relaxed);
+		Symbol.store(symbol, std::memory_order_relaxed);
+		Untyped.store(untyped, std::memory_order_relaxed);
+		Sequence.store(sequence + 2, std::memory_order_release);
+	}
+};
+
 struct ScriptFunction
 {
 	PathType Name;
 
 	std::vector<Variable> StringTable;
 	ankerl::unordered_dense::set<double> NumberTable;
+	// NumberTable with integers already narrowed, built once the table is complete
+	std::vector<Variable> NumberConstants;
 
 	std::vector<FunctionSymbol*> FunctionTable;
 	std::vector<Variable*> GlobalTable;
-	std::vector<int32_t> PropertyTable;
+	std::vector<PropertyCache> PropertyTable;
+	std::vector<CallCache> CallTable;
 	std::vector<VariableType> TypeTable;
 
 	std::vector<PathTypeQuery> FunctionTableSymbols;
@@ -142,6 +264,8 @@ struct ScriptFunction
 	bool IsPublic;
 
 	std::vector<uint32_t> Bytecode;
+	// Instructions replaced with OpCodes::Break, instruction index -> original instruction
+	ankerl::unordered_dense::map<uint32_t, uint32_t> Breakpoints;
 
 	ScriptFunction() : Name(nullptr) {
 		FunctionScope = nullptr;
@@ -154,5 +278,14 @@ struct ScriptFunction
 	}
 
 	void Append(ScriptFunction fn);
+	// Decides once for every number constant whether it loads as an integer
+	void BuildNumberConstants();
+
+	// Splits a fused pair back into two instructions when the second one is at instruction
+	void Unfuse(size_t instruction);
+	bool SetBreakpoint(size_t instruction);
+	bool ClearBreakpoint(size_t instruction);
+	uint32_t GetOriginalInstruction(size_t instruction) const;
+	std::vector<uint32_t> GetOriginalBytecode() const;
 };
 
@@ -19,7 +19,7 @@ Variable CopyToVM(const InternalValue& var)
 	} break;
 
 	case ValueType::Number:
-		return var.as<double>();
+		return narrowNumber(var.as<double>());
 	case ValueType::Boolean:
 		return var.as<bool>();
 	case ValueType::External:
@@ -77,7 +77,7 @@ Variable GetTypeDefault(VariableType type)
 	case VariableType::Undefined:
 		return Variable();
 	case VariableType::Number:
-		return Variable(0.0);
+		return Variable(0);
 	case VariableType::Boolean:
 		return Variable(false);
 	case VariableType::External:
@@ -111,7 +111,7 @@ Variable CopyVariable(const Variable& var)
 		return Array::GetAllocator()->Copy(var.as<Array>());
 	case VariableType::Object:
 	default:
-		return UserObject::GetAllocator()->Copy(var.as<UserObject>());
+		return UserObject::Copy(var.as<UserObject>());
 	}
 }
 
@@ -162,8 +162,8 @@ bool equal(const Variable& lhs, const Variable& rhs)
 	if (lhs.getType() != rhs.getType()) return false;
 	switch (lhs.getType())
 	{
-	case VariableType::String: return strcmp(lhs.as<String>()->data(), rhs.as<String>()->data()) == 0;
-	case VariableType::Number: return abs(lhs.as<double>() - rhs.as<double>()) <= 0.00001;
+	case VariableType::String: return lhs.as<String>()->Equals(rhs.as<String>());
+	case VariableType::Number: return numequal(lhs, rhs);
 	case VariableType::Boolean: return lhs.as<bool>() == rhs.as<bool>();
 	default:
 		return lhs.operator==(rhs);
@@ -203,7 +203,11 @@ void add(Variable& out, const Variable& lhs, const Variable& rhs)
 {
 	switch (lhs.getType())
 	{
-	case VariableType::Number: out = lhs.as<double>() + toNumber(rhs); return;
+	case VariableType::Number: {
+		if (rhs.isNumber()) numadd(out, lhs, rhs);
+		else out = lhs.as<double>() + toNumber(rhs);
+		return;
+	}
 	case VariableType::String: stradd(out, lhs, rhs); return;
 
 	default:
@@ -215,7 +219,11 @@ void sub(Variable& out, const Variable& lhs, const Variable& rhs)
 {
 	switch (lhs.getType())
 	{
-	case VariableType::Number: out = lhs.as<double>() - toNumber(rhs); return;
+	case VariableType::Number: {
+		if (rhs.isNumber()) numsub(out, lhs, rhs);
+		else out = lhs.as<double>() - toNumber(rhs);
+		return;
+	}
 
 	default:
 		return;
@@ -227,7 +235,7 @@ void mul(Variable& out, const Variable& lhs, const Variable& rhs)
 	if (lhs.getType() != rhs.getType()) return;
 	switch (lhs.getType())
 	{
-	case VariableType::Number: out = lhs.as<double>() * rhs.as<double>(); return;
+	case VariableType::Number: nummul(out, lhs, rhs); return;
 
 	default:
 		return;
@@ -285,10 +293,9 @@ String* toString(const Variable& in)
 	case VariableType::Function: return alloc->Make((const char*)in.as<FunctionObject>()->Name);
 	case VariableType::Array: {
 		std::string out = "[ ";
-		size_t index = 0;
-		auto& arr = in.as<Array>()->data();
-		for (auto& var : arr) {
-			out += toStdString(var) + (index++ + 1 < arr.size() ? ", " : "");
+		auto arr = in.as<Array>();
+		for (size_t index = 0; index < arr->size(); index++) {
+			out += toStdString(arr->get(index)) + (index + 1 < arr->size() ? ", " : "");
 		}
 		out += " ]";
 		return alloc->Make(out.c_str(), out.size());
@@ -314,10 +321,9 @@ std::string toStdString(const Variable& in)
 	case VariableType::Function: return in.as<FunctionObject>()->Name.toString();
 	case VariableType::Array: {
 		std::string out = "[ ";
-		size_t index = 0; 
-		auto& arr = in.as<Array>()->data();
-		for (auto& var : arr) {
-			out += toStdString(var) + (index++ + 1 < arr.size() ? ", " : "");
+		auto arr = in.as<Array>();
+		for (size_t index = 0; index < arr->size(); index++) {
+			out += toStdString(arr->get(index)) + (index + 1 < arr->size() ? ", " : "");
 		}
 		return out + " ]";
 	} 
@@ -2,6 +2,7 @@
 #include "EMIDev/Variable.h"
 #include "EMI/Value.h"
 #include <string>
+#include <cmath>
 
 // @todo: These should be inlined
 
@@ -25,6 +26,58 @@ void div(Variable& out, const Variable& lhs, const Variable& rhs);
 
 double toNumber(const Variable& in);
 
+// Integer results are kept as integers while they fit, everything else falls back to doubles.
+// -0 stays a double so dividing by it keeps the sign
+inline Variable narrowNumber(double value)
+{
+	if (value >= INT32_MIN && value <= INT32_MAX) {
+		int32_t integer = static_cast<int32_t>(value);
+		if (integer == value && (integer != 0 || !std::signbit(value))) return integer;
+	}
+	return value;
+}
+
+inline void numadd(Variable& out, const Variable& lhs, const Variable& rhs)
+{
+	if (lhs.isInt() && rhs.isInt()) {
+		int64_t result = (int64_t)lhs.asInt() + rhs.asInt();
+		if (result == (int32_t)result) { out = (int32_t)result; return; }
+	}
+	out = lhs.as<double>() + rhs.as<double>();
+}
+
+inline void numsub(Variable& out, const Variable& lhs, const Variable& rhs)
+{
+	if (lhs.isInt() && rhs.isInt()) {
+		int64_t result = (int64_t)lhs.asInt() - rhs.asInt();
+		if (result == (int32_t)result) { out = (int32_t)result; return; }
+	}
+	out = lhs.as<double>() - rhs.as<double>();
+}
+
+inline void nummul(Variable& out, const Variable& lhs, const Variable& rhs)
+{
+	if (lhs.isInt() && rhs.isInt()) {
+		int64_t result = (int64_t)lhs.asInt() * rhs.asInt();
+		// A zero product with a negative operand is -0
+		if (result == (int32_t)result && (result != 0 || (lhs.asInt() >= 0 && rhs.asInt() >= 0))) { out = (int32_t)result; return; }
+	}
+	out = lhs.as<double>() * rhs.as<double>();
+}
+
+inline bool numequal(const Variable& lhs, const Variable& rhs)
+{
+	if (lhs.isInt() && rhs.isInt()) return lhs.asInt() == rhs.asInt();
+	double diff = lhs.as<double>() - rhs.as<double>();
+	return diff < 0.00001 && diff > -0.00001;
+}
+
+inline size_t toIndex(const Variable& in)
+{
+	if (in.isInt()) return static_cast<size_t>(in.asInt());
+	return static_cast<size_t>(toNumber(in));
+}
+
 class String;
 String* toString(const Variable& in);
 std::string toStdString(const Variable& in);
@@ -5,6 +5,7 @@
 #include "Objects/UserObject.h"
 #include "Helpers.h"
 #include "Function.h"
+#include "VM.h"
 #include <numeric>
 #include <math.h>
 #include <thread>
@@ -27,15 +28,35 @@ void printLn(Variable& out, Variable* args, size_t argc) {
 	}
 }
 
+// Calls run from the queue are parked and free their runner, synchronous and batched calls block instead
 void delay(Variable&, Variable* args, size_t argc) {
 	if (argc > 0) {
-		std::this_thread::sleep_for(std::chrono::milliseconds((size_t)toNumber(args[0])));
+		auto time = std::chrono::milliseconds((int64_t)toNumber(args[0]));
+		Runner* runner = Runner::Current();
+		if (runner && runner->ParkTimer(std::chrono::steady_clock::now() + time)) return;
+		std::this_thread::sleep_for(time);
+	}
+}
+
+void yieldCall(Variable&, Variable*, size_t) {
+	if (Runner* runner = Runner::Current()) {
+		runner->ParkYield();
+	}
+}
+
+void waitEvent(Variable& out, Variable* args, size_t argc) {
+	out.setUndefined();
+	if (argc > 0) {
+		Runner* runner = Runner::Current();
+		if (!runner || !runner->ParkEvent(toStdString(args[0]), out)) {
+			gRuntimeWarn() << "Synchronous and batched calls cannot wait for events";
+		}
 	}
 }
 
 void arraySize(Variable& out, Variable* args, size_t argc) {
 	if (argc == 1 && args[0].getType() == VariableType::Array) {
-		out = static_cast<double>(args[0].as<Array>()->size());
+		out = static_cast<int>(args[0].as<Array>()->size());
 	}
 	else {
 		out.setUndefined();
@@ -49,7 +70,7 @@ void arrayResize(Variable& out, Variable* args, size_t argc) {
 		if (argc == 3) {
 			fill = args[2];
 		}
-		args[0].as<Array>()->data().resize(size, fill);
+		args[0].as<Array>()->resize(size, fill);
 		out = static_cast<double>(size);
 	}
 	else {
@@ -59,28 +80,24 @@ void arrayResize(Variable& out, Variable* args, size_t argc) {
 
 void arrayPush(Variable&, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		data.push_back(args[1]);
+		args[0].as<Array>()->push(args[1]);
 	}
 }
 
 void arrayPushFront(Variable&, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		data.insert(data.begin(), args[1]);
+		args[0].as<Array>()->insert(0, args[1]);
 	}
 }
 
 void arrayPushUnique(Variable& out, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		if (auto it = std::find(data.begin(), data.end(), args[1]); it == data.end()) {
-			data.push_back(args[1]);
-			out = static_cast<int>(data.size() - 1);
-		}
-		else {
-			out = static_cast<int>(it - data.begin());
+		auto arr = args[0].as<Array>();
+		size_t idx = arr->find(args[1]);
+		if (idx == arr->size()) {
+			arr->push(args[1]);
 		}
+		out = static_cast<int>(idx);
 	}
 	else {
 		out.setUndefined();
@@ -89,45 +106,42 @@ void arrayPushUnique(Variable& out, Variable* args, size_t argc) {
 
 void arrayPop(Variable&, Variable* args, size_t argc) {
 	if (argc == 1 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		if (!data.empty()) {
-			data.pop_back();
-		}
+		args[0].as<Array>()->visit([](auto& data) {
+			if (!data.empty()) {
+				data.pop_back();
+			}
+		});
 	}
 }
 
 void arrayRemove(Variable&, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		std::erase(data, args[1]);
+		const Variable& value = args[1];
+		args[0].as<Array>()->visit([&value](auto& data) {
+			std::erase_if(data, [&value](const auto& item) { return Array::matches(item, value); });
+		});
 	}
 }
 
 void arrayRemoveIdx(Variable&, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
 		auto idx = toNumber(args[1]);
-		if (idx < data.size())
-			data.erase(data.begin() + static_cast<size_t>(idx));
+		args[0].as<Array>()->visit([idx](auto& data) {
+			if (idx < data.size())
+				data.erase(data.begin() + static_cast<size_t>(idx));
+		});
 	}
 }
 
 void arrayClear(Variable&, Variable* args, size_t argc) {
 	if (argc == 1 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		data.clear();
+		args[0].as<Array>()->visit([](auto& data) { data.clear(); });
 	}
 }
 
 void arrayFind(Variable& out, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		if (auto it = std::find(data.begin(), data.end(), args[1]); it != data.end()) {
-			out = static_cast<int>(it - data.begin());
-		}
-		else {
-			out = static_cast<int>(data.size());
-		}
+		out = static_cast<int>(args[0].as<Array>()->find(args[1]));
 	}
 	else {
 		out.setUndefined();
@@ -139,10 +153,7 @@ void copy(Variable& out, Variable* args, size_t argc) {
 		switch (args[0].getType())
 		{
 		case VariableType::Array: {
-			auto& old = args[0].as<Array>()->data();
-			auto next = Array::GetAllocator()->Make();
-			next->data() = old;
-			out = next;
+			out = Array::GetAllocator()->Copy(args[0].as<Array>());
 		} break;
 
 		case VariableType::String: {
@@ -221,15 +232,14 @@ void mathclamp(Variable& out, Variable* args, size_t argc) {
 
 void arrayReverse(Variable&, Variable* args, size_t argc) {
 	if (argc == 1 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		std::reverse(data.begin(), data.end());
+		args[0].as<Array>()->visit([](auto& data) { std::reverse(data.begin(), data.end()); });
 	}
 }
 
 void arrayContains(Variable& out, Variable* args, size_t argc) {
 	if (argc == 2 && args[0].getType() == VariableType::Array) {
-		auto& data = args[0].as<Array>()->data();
-		out = std::find(data.begin(), data.end(), args[1]) != data.end() ? 1.0 : 0.0;
+		auto arr = args[0].as<Array>();
+		out = arr->find(args[1]) != arr->size() ? 1.0 : 0.0;
 	}
 	else {
 		out.setUndefined();
@@ -273,6 +283,8 @@ SymbolTable IntrinsicFunctions = { {
 	AddFunction("println", printLn, VariableType::Undefined, { {"text", VariableType::String } }),
 
 	AddFunction("delay", delay, VariableType::Undefined, { {"delay", VariableType::Number } }),
+	AddFunction("yield", yieldCall, VariableType::Undefined, {}),
+	AddFunction("wait", waitEvent, VariableType::Undefined, { {"event", VariableType::String } }, true),
 
 	AddNamespace("Array"),
 	AddFunction("Array.Size", arraySize,				VariableType::Number,	 { {"array", VariableType::Array } }, true),
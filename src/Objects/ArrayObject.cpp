@@ -1,16 +1,19 @@
 #include "ArrayObject.h"
+#include "Helpers.h"
 
 Array::Array(size_t s)
 {
 	Type = VariableType::Array;
-	Data.clear();
-	Data.reserve(s);
+	Storage = ArrayStorage::Int;
+	Ints.reserve(s);
 }
 
 Array::Array(const Array& array)
 {
 	Type = VariableType::Array;
-	Data.clear();
+	Storage = array.Storage;
+	Ints = array.Ints;
+	Numbers = array.Numbers;
 	Data = array.Data;
 }
 
@@ -21,17 +24,134 @@ Array::~Array()
 
 void Array::Realloc(size_t s)
 {
+	Storage = ArrayStorage::Int;
+	Ints.clear();
+	Numbers.clear();
 	Data.clear();
-	Data.reserve(s);
+	Ints.reserve(s);
 }
 
 void Array::Clear()
 {
+	Ints.clear();
+	Numbers.clear();
 	Data.clear();
 }
 
+void Array::Trace(std::vector<Object*>& out)
+{
+	for (auto& var : Data) {
+		if (var.isObject() && var.as<Object>()->IsContainer()) {
+			out.push_back(var.as<Object>());
+		}
+	}
+}
+
+std::vector<Variable>& Array::data()
+{
+	Upgrade(Variable{});
+	return Data;
+}
+
+void Array::push(const Variable& value)
+{
+	if (Storage == ArrayStorage::Int && value.isInt()) [[likely]] {
+		Ints.push_back(value.asInt());
+		return;
+	}
+	Upgrade(value);
+	switch (Storage)
+	{
+	case ArrayStorage::Int: Ints.push_back(value.as<int32_t>()); break;
+	case ArrayStorage::Number: Numbers.push_back(value.as<double>()); break;
+	default: Data.push_back(value); break;
+	}
+}
+
+void Array::insert(size_t idx, const Variable& value)
+{
+	Upgrade(value);
+	switch (Storage)
+	{
+	case ArrayStorage::Int: Ints.insert(Ints.begin() + idx, value.as<int32_t>()); break;
+	case ArrayStorage::Number: Numbers.insert(Numbers.begin() + idx, value.as<double>()); break;
+	default: Data.insert(Data.begin() + idx, value); break;
+	}
+}
+
+void Array::resize(size_t size, const Variable& fill)
+{
+	if (size > this->size()) Upgrade(fill);
+	switch (Storage)
+	{
+	case ArrayStorage::Int: Ints.resize(size, fill.isNumber() ? fill.as<int32_t>() : 0); break;
+	case ArrayStorage::Number: Numbers.resize(size, fill.isNumber() ? fill.as<double>() : 0.0); break;
+	default: Data.resize(size, fill); break;
+	}
+}
+
+size_t Array::find(const Variable& value) const
+{
+	switch (Storage)
+	{
+	case ArrayStorage::Int: {
+		if (!value.isNumber()) return Ints.size();
+		for (size_t i = 0; i < Ints.size(); i++) {
+			if (matches(Ints[i], value)) return i;
+		}
+		return Ints.size();
+	}
+	case ArrayStorage::Number: {
+		if (!value.isNumber()) return Numbers.size();
+		for (size_t i = 0; i < Numbers.size(); i++) {
+			if (matches(Numbers[i], value)) return i;
+		}
+		return Numbers.size();
+	}
+	default: {
+		for (size_t i = 0; i < Data.size(); i++) {
+			if (matches(Data[i], value)) return i;
+		}
+		return Data.size();
+	}
+	}
+}
+
+void Array::Upgrade(const Variable& value)
+{
+	switch (Storage)
+	{
+	case ArrayStorage::Int: {
+		if (value.isInt()) return;
+		if (value.isNumber()) {
+			double number = value.as<double>();
+			if (narrowNumber(number).isInt()) return;
+			Numbers.assign(Ints.begin(), Ints.end());
+			Ints.clear();
+			Storage = ArrayStorage::Number;
+			return;
+		}
+		Data.reserve(Ints.size());
+		for (auto i : Ints) Data.emplace_back(i);
+		Ints.clear();
+		Storage = ArrayStorage::Generic;
+	} break;
+
+	case ArrayStorage::Number: {
+		if (value.isNumber()) return;
+		Data.reserve(Numbers.size());
+		for (auto d : Numbers) Data.emplace_back(d);
+		Numbers.clear();
+		Storage = ArrayStorage::Generic;
+	} break;
+
+	default:
+		break;
+	}
+}
+
 Allocator<Array>* Array::GetAllocator()
 {
 	static Allocator<Array> alloc;
 	return &alloc;
-}
\ No newline at end of file
+}
@@ -3,6 +3,16 @@
 
 class ArrayAllocator;
 
+// Arrays holding only numbers are stored packed, as int32 while every value is integral and as
+// double otherwise. Storing anything else upgrades the array to generic storage, it is never
+// packed again until reallocated.
+enum class ArrayStorage : uint8_t
+{
+	Int,
+	Number,
+	Generic,
+};
+
 class Array : public Object
 {
 public:
@@ -13,13 +23,77 @@ public:
 
 	void Realloc(size_t s);
 	void Realloc() { Realloc(0); }
-	void Clear();
+	void Clear() override;
+	void Trace(std::vector<Object*>& out) override;
+
+	// Converts the array to generic storage
+	std::vector<Variable>& data();
+	size_t size() const {
+		switch (Storage)
+		{
+		case ArrayStorage::Int: return Ints.size();
+		case ArrayStorage::Number: return Numbers.size();
+		default: return Data.size();
+		}
+	}
+
+	ArrayStorage storage() const { return Storage; }
+
+	Variable get(size_t idx) const {
+		switch (Storage)
+		{
+		case ArrayStorage::Int: return Ints[idx];
+		case ArrayStorage::Number: return Numbers[idx];
+		default: return Data[idx];
+		}
+	}
 
-	std::vector<Variable>& data() { return Data; }
-	size_t size() const { return Data.size(); }
+	void set(size_t idx, const Variable& value) {
+		if (Storage == ArrayStorage::Int && value.isInt()) [[likely]] Ints[idx] = value.asInt();
+		else if (Storage == ArrayStorage::Number && value.isNumber()) Numbers[idx] = value.as<double>();
+		else {
+			Upgrade(value);
+			switch (Storage)
+			{
+			case ArrayStorage::Int: Ints[idx] = value.as<int32_t>(); break;
+			case ArrayStorage::Number: Numbers[idx] = value.as<double>(); break;
+			default: Data[idx] = value; break;
+			}
+		}
+	}
+
+	void push(const Variable& value);
+	void insert(size_t idx, const Variable& value);
+	void resize(size_t size, const Variable& fill);
+	// Returns size() if the value is not found, numbers compare by value
+	size_t find(const Variable& value) const;
+
+	// Element comparison used by find, numbers compare by value
+	static bool matches(int32_t item, const Variable& value) { return value.isNumber() && item == value.as<double>(); }
+	static bool matches(double item, const Variable& value) { return value.isNumber() && item == value.as<double>(); }
+	static bool matches(const Variable& item, const Variable& value) {
+		return item == value || (value.isNumber() && item.isNumber() && item.as<double>() == value.as<double>());
+	}
+
+	// Calls the function with the active storage vector
+	template <typename F>
+	decltype(auto) visit(F&& func) {
+		switch (Storage)
+		{
+		case ArrayStorage::Int: return func(Ints);
+		case ArrayStorage::Number: return func(Numbers);
+		default: return func(Data);
+		}
+	}
 
 	static Allocator<Array>* GetAllocator();
 
 private:
+	// Changes the storage so that the value can be stored
+	void Upgrade(const Variable& value);
+
+	ArrayStorage Storage;
+	std::vector<int32_t> Ints;
+	std::vector<double> Numbers;
 	std::vector<Variable> Data;
-};
\ No newline at end of file
+};
@@ -1,22 +1,57 @@
 #include "StringObject.h"
+#include <vector>
+
+/**
+
+Buffers for strings that do not fit inline are rounded up to a power of two size class.
+Freed buffers are kept in per-thread free lists, larger buffers go directly to the heap.
+
+*/
+static constexpr size_t MinClassShift = 6;
+static constexpr size_t ClassCount = 7;
+static constexpr size_t MaxCachedBuffers = 64;
+
+struct BufferCache
+{
+	std::vector<char*> Free[ClassCount];
+
+	~BufferCache() {
+		for (auto& list : Free) {
+			for (auto buffer : list) delete[] buffer;
+		}
+	}
+};
+
+static thread_local BufferCache Buffers;
+
+static size_t SizeClass(size_t len)
+{
+	size_t cls = 0;
+	while ((size_t(1) << (cls + MinClassShift)) < len) cls++;
+	return cls;
+}
 
 String::String(const char* str, size_t s)
 {
 	Type = VariableType::String;
+	Data = Inline;
+	Capacity = InlineSize;
+	Hash.store(0, std::memory_order_relaxed);
+	AllocBuffer(s);
 	Size = s;
-	Data = new char[s]();
 	if (str) memcpy(Data, str, s - 1);
 	Data[s - 1] = '\0';
-	Capacity = Size;
 }
 
 String::String(const String& str)
 {
 	Type = VariableType::String;
+	Data = Inline;
+	Capacity = InlineSize;
+	AllocBuffer(str.Size);
 	Size = str.Size;
-	Data = new char[Size]();
+	Hash.store(str.Hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
 	memcpy(Data, str.Data, Size);
-	Capacity = Size;
 }
 
 Allocator<String>* String::GetAllocator()
@@ -28,15 +63,58 @@ Allocator<String>* String::GetAllocator()
 void String::Realloc(const char* str, size_t len)
 {
 	if (Capacity < len) {
-		delete[] Data;
-		Size = len;
-		Data = new char[len]();
-		if (str) memcpy(Data, str, len - 1);
-		Data[len - 1] = '\0';
-		Capacity = Size;
+		FreeBuffer();
+		AllocBuffer(len);
+		if (!str) memset(Data, 0, len);
+	}
+	Size = len;
+	Hash.store(0, std::memory_order_relaxed);
+	if (str) memcpy(Data, str, len - 1);
+	Data[len - 1] = '\0';
+}
+
+void String::AllocBuffer(size_t len)
+{
+	if (len <= Capacity) return;
+	size_t cls = SizeClass(len);
+	if (cls >= ClassCount) {
+		Data = new char[len];
+		Capacity = len;
+		return;
+	}
+	auto& list = Buffers.Free[cls];
+	Capacity = size_t(1) << (cls + MinClassShift);
+	if (list.empty()) {
+		Data = new char[Capacity];
 	}
 	else {
-		Size = len;
-		if (str != nullptr) memcpy(Data, str, len);
+		Data = list.back();
+		list.pop_back();
+	}
+}
+
+void String::FreeBuffer()
+{
+	if (Data != Inline) {
+		size_t cls = SizeClass(Capacity);
+		if (cls < ClassCount && Buffers.Free[cls].size() < MaxCachedBuffers) {
+			Buffers.Free[cls].push_back(Data);
+		}
+		else {
+			delete[] Data;
+		}
+	}
+	Data = Inline;
+	Capacity = InlineSize;
+}
+
+uint32_t String::ComputeHash() const
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i + 1 < Size; i++) {
+		h ^= static_cast<uint8_t>(Data[i]);
+		h *= 16777619u;
 	}
-}
\ No newline at end of file
+	// Zero marks a hash that has not been computed
+	return h != 0 ? h : 1;
+}
@@ -16,19 +16,57 @@ public:
 	void Realloc() { Realloc("", 1); }
 
 	~String() {
-		delete[] Data;
-		Data = nullptr;
+		FreeBuffer();
 	}
 
+	// Writing through data() is only allowed before the string is hashed or compared
 	char* data() { return Data; }
+	// Size includes the terminator
 	size_t size() const { return Size; }
+	size_t length() const { return Size - 1; }
+
+	// FNV-1a, stored for literals when they are made and computed on first use for other strings.
+	// Racing runners compute the same value.
+	uint32_t hash() const {
+		uint32_t hash = Hash.load(std::memory_order_relaxed);
+		if (hash == 0) [[unlikely]] {
+			hash = ComputeHash();
+			Hash.store(hash, std::memory_order_relaxed);
+		}
+		return hash;
+	}
+
+	// Literals are shared by every runner and compared often, the hash is stored before they are shared
+	void MakeLiteral() {
+		hash();
+		MakeImmortal();
+	}
+
+	// Strings with stored hashes are rejected without comparing the data
+	bool Equals(const String* other) const {
+		if (this == other) return true;
+		if (Size != other->Size) return false;
+		uint32_t hash = Hash.load(std::memory_order_relaxed);
+		uint32_t otherHash = other->Hash.load(std::memory_order_relaxed);
+		if (hash != 0 && otherHash != 0 && hash != otherHash) return false;
+		return memcmp(Data, other->Data, Size - 1) == 0;
+	}
 
 	static Allocator<String>* GetAllocator();
 
 	void Realloc(const char* str, size_t len);
 
 private:
+	// Short strings are stored in the object, longer ones in size class buffers
+	static constexpr size_t InlineSize = 32;
+
+	void AllocBuffer(size_t len);
+	void FreeBuffer();
+	uint32_t ComputeHash() const;
+
 	char* Data;
 	size_t Size;
 	size_t Capacity;
-};
\ No newline at end of file
+	mutable std::atomic<uint32_t> Hash;
+	char Inline[InlineSize];
+};
@@ -25,8 +25,8 @@ Variable ObjectManager::Make(VariableType type) const
 {
 	if (auto it = BaseTypes.find(type); it != BaseTypes.end()) {
 
-		UserObject* object = UserObject::GetAllocator()->Make(type, (uint16_t)it->second.DefaultFields.size());
-		object->RefCount++;
+		UserObject* object = UserObject::Make(type, (uint16_t)it->second.DefaultFields.size());
+		object->AddRef();
 
 		uint16_t idx = 0;
 		for (size_t i = 0; i < it->second.DefaultFields.size(); ++i) {
@@ -46,7 +46,7 @@ Variable ObjectManager::Make(VariableType type) const
 			idx++;
 		}
 
-		object->RefCount--;
+		object->Release();
 
 		return object;
 	}
@@ -116,6 +116,7 @@ UserObject::UserObject(VariableType type, uint16_t count)
 	Type = type;
 	Data = new Variable[count];
 	DataCount = count;
+	OwnsData = true;
 }
 
 UserObject::UserObject(const UserObject& object)
@@ -123,18 +124,24 @@ UserObject::UserObject(const UserObject& object)
 	Type = object.Type;
 	DataCount = object.DataCount;
 	Data = new Variable[DataCount];
-	for (int i = 0; i < DataCount; ++i) {
-		Data[i] = CopyVariable(object.Data[i]);
-	}
+	OwnsData = true;
+	CopyFields(object);
 }
 
 UserObject::~UserObject()
 {
-	delete[] Data;
+	if (OwnsData) delete[] Data;
 	Data = nullptr;
 	DataCount = 0;
 }
 
+void UserObject::CopyFields(const UserObject& object)
+{
+	for (int i = 0; i < DataCount; ++i) {
+		Data[i] = CopyVariable(object.Data[i]);
+	}
+}
+
 void UserObject::Clear()
 {
 	for (int i = 0; i < DataCount; ++i) {
@@ -142,12 +149,63 @@ void UserObject::Clear()
 	}
 }
 
+void UserObject::Trace(std::vector<Object*>& out)
+{
+	for (int i = 0; i < DataCount; ++i) {
+		if (Data[i].isObject() && Data[i].as<Object>()->IsContainer()) {
+			out.push_back(Data[i].as<Object>());
+		}
+	}
+}
+
 Allocator<UserObject>* UserObject::GetAllocator()
 {
 	static Allocator<UserObject> alloc;
 	return &alloc;
 }
 
+// Calls the function with the pool used for the field count
+template <typename F>
+static UserObject* WithPool(uint16_t count, F&& func)
+{
+	if (count <= 1) return func(InlineUserObject<1>::GetAllocator());
+	if (count <= 2) return func(InlineUserObject<2>::GetAllocator());
+	if (count <= 4) return func(InlineUserObject<4>::GetAllocator());
+	if (count <= 8) return func(InlineUserObject<8>::GetAllocator());
+	if (count <= 16) return func(InlineUserObject<16>::GetAllocator());
+	return func(UserObject::GetAllocator());
+}
+
+UserObject* UserObject::Make(VariableType type, uint16_t count)
+{
+	return WithPool(count, [type, count](auto alloc) -> UserObject* {
+		return alloc->Make(type, count);
+	});
+}
+
+template <class T>
+static T* CopyFrom(Allocator<T>* alloc, const UserObject* object)
+{
+	return alloc->Make(*static_cast<const T*>(object));
+}
+
+UserObject* UserObject::Copy(const UserObject* object)
+{
+	return WithPool(object->DataCount, [object](auto alloc) -> UserObject* {
+		return CopyFrom(alloc, object);
+	});
+}
+
+void UserObject::SetPacing(size_t allocations, size_t slice)
+{
+	InlineUserObject<1>::GetAllocator()->SetPacing(allocations, slice);
+	InlineUserObject<2>::GetAllocator()->SetPacing(allocations, slice);
+	InlineUserObject<4>::GetAllocator()->SetPacing(allocations, slice);
+	InlineUserObject<8>::GetAllocator()->SetPacing(allocations, slice);
+	InlineUserObject<16>::GetAllocator()->SetPacing(allocations, slice);
+	GetAllocator()->SetPacing(allocations, slice);
+}
+
 ObjectManager& GetManager()
 {
 	static ObjectManager manager;
@@ -7,12 +7,19 @@
 
 class ObjectManager;
 
+// Fields of objects with up to 16 fields are stored inline, in pools shared by every type of the same
+// size class: 1, 2, 4, 8 or 16 fields. Field counts are rounded up to the class, so a type with 5 fields
+// carries 3 unused slots. Objects with more fields come from a separate pool and allocate their fields
+// with new[], which costs the second allocation and cache miss for large types.
+// Size classes are used since the allocator builds fixed size objects, one pool per type would need
+// storage sized at run time.
 class UserObject : public Object
 {
 public:
 	UserObject() {
 		Data = nullptr;
 		DataCount = 0;
+		OwnsData = false;
 		Type = VariableType::Object;
 	}
 
@@ -20,10 +27,17 @@ public:
 	UserObject(const UserObject& object);
 	~UserObject();
 
-	void Clear();
+	void Clear() override;
+	void Trace(std::vector<Object*>& out) override;
 
+	// Pool for types with more fields than the largest inline class, the fields are allocated separately
 	static Allocator<UserObject>* GetAllocator();
 
+	// Takes the object from the smallest size class the field count fits in
+	static UserObject* Make(VariableType type, uint16_t count);
+	static UserObject* Copy(const UserObject* object);
+	static void SetPacing(size_t allocations, size_t slice);
+
 	uint16_t size() const { return DataCount; }
 
 	Variable& operator[](uint16_t index) {
@@ -32,10 +46,45 @@ public:
 		return Data[0];
 	}
 
-private:
+protected:
+	UserObject(VariableType type, uint16_t count, Variable* fields) {
+		Type = type;
+		Data = fields;
+		DataCount = count;
+		OwnsData = false;
+	}
+
+	void CopyFields(const UserObject& object);
 
 	Variable* Data;
 	uint16_t DataCount;
+	bool OwnsData;
+};
+
+// Size class for objects with at most N fields, the fields are stored in the same allocation
+template <uint16_t N>
+class InlineUserObject : public UserObject
+{
+public:
+	InlineUserObject() : UserObject(VariableType::Object, 0, Fields) {}
+	InlineUserObject(VariableType type, uint16_t count) : UserObject(type, count, Fields) {}
+	InlineUserObject(const InlineUserObject& object) : UserObject(object.Type, object.DataCount, Fields) {
+		CopyFields(object);
+	}
+
+	// Pooled objects have been cleared, only the header needs to be set
+	void Realloc(VariableType type, uint16_t count) {
+		Type = type;
+		DataCount = count;
+	}
+
+	static Allocator<InlineUserObject>* GetAllocator() {
+		static Allocator<InlineUserObject> alloc;
+		return &alloc;
+	}
+
+private:
+	Variable Fields[N];
 };
 
 
@@ -47,3 +47,21 @@ X(StoreIndex)
 X(LoadIndex)
 X(RangeFor)
 X(RangeForVar)
+X(LessJumpNeg)
+X(LessEqualJumpNeg)
+X(GreaterJumpNeg)
+X(GreaterEqualJumpNeg)
+X(LoadNumberNumAdd)
+X(LoadNumberNumSub)
+X(LoadPropertyCallSymbol)
+X(CopyCallFunction)
+X(AddNumber)
+X(SubNumber)
+X(MulNumber)
+X(DivNumber)
+X(LessNumber)
+X(EqualNumber)
+X(TailCallFunction)
+X(TailCallSymbol)
+X(LoadImmediateNumAdd)
+X(LoadImmediateNumSub)
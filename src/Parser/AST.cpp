@@ -871,8 +871,17 @@ void ASTWalker::handle_Typename(Node* n) {
 }
 
 void ASTWalker::handle_Number(Node* n) {
+	double value = std::get<double>(n->data);
+	// Small integers are encoded in the instruction and load as integers, -0 keeps its sign as a double
+	if (value >= INT16_MIN && value <= INT16_MAX && (int16_t)value == value && !std::signbit(value)) {
+		Op(LoadImmediate);
+		In16 = (uint16_t)(int16_t)value;
+		Out;
+		NodeType = VariableType::Number;
+		return;
+	}
 	Op(LoadNumber);
-	auto res = CurrentFunction->NumberTable.emplace(std::get<double>(n->data));
+	auto res = CurrentFunction->NumberTable.emplace(value);
 	uint16_t idx = (uint16_t)std::distance(CurrentFunction->NumberTable.begin(), res.first);
 	In16 = idx;
 	Out;
@@ -1465,6 +1474,12 @@ void ASTWalker::handle_ObjectInit(Node* n) {
 
 void ASTWalker::handle_Return(Node* n) {
 	Walk;
+	if (!n->children.empty() && n->children.front()->type == Token::FunctionCall) {
+		// Tail call replaces the current frame, the Return is left for host and intrinsic calls
+		auto& call = InstructionList[n->children.front()->instruction];
+		if (call.code == OpCodes::CallFunction) call.code = OpCodes::TailCallFunction;
+		else if (call.code == OpCodes::CallSymbol) call.code = OpCodes::TailCallSymbol;
+	}
 	Op(Return);
 	if (!n->children.empty()) {
 		GetFirstNode()
@@ -1813,7 +1828,11 @@ function:
 	case 0: arg.data = (uint32_t)index; break;
 	case 1: arg.data = (uint32_t)index; break;
 	case 2: arg.data = (uint32_t)index; break;
-	case 3: arg.target = first->regTarget; break;
+	case 3: {
+		arg.target = first->regTarget;
+		arg.param = (uint16_t)CurrentFunction->CallTable.size();
+		CurrentFunction->CallTable.emplace_back();
+	} break;
 	case 4: arg.data = (uint32_t)index; break;
 	}
 }
@@ -2080,21 +2099,21 @@ void ASTWalker::HandleFunction(Node* n, ScriptFunction* f, CompileSymbol* s)
 		}
 	}
 
-	if (HasDebug) {
-		for (auto point : BreakPoints) { // @todo: Do something better here, now it cannot be last instruction
-			auto inst = CurrentDebugFunction->GetInstructionForLine(point);
-			if (inst == -1) continue;
-			Instruction op;
-			op.code = OpCodes::Break;
-			InstructionList.insert(InstructionList.begin() + inst, op);
-		}
-	}
+	FuseInstructions();
 
 	f->Bytecode.resize(InstructionList.size());
 	for (size_t i = 0; i < InstructionList.size(); i++) {
 		f->Bytecode[i] = InstructionList[i].data;
 	}
 
+	if (HasDebug) {
+		for (auto point : BreakPoints) {
+			auto inst = CurrentDebugFunction->GetInstructionForLine(point);
+			if (inst == -1) continue;
+			f->SetBreakpoint(inst);
+		}
+	}
+
 #ifdef DEBUG
 	gCompileDebug() << "Function " << f->Name.toString();
 	gCompileLogger() << "\n----------------------------------\n";
@@ -2104,15 +2123,18 @@ void ASTWalker::HandleFunction(Node* n, ScriptFunction* f, CompileSymbol* s)
 #endif // DEBUG
 
 	f->FunctionTable.resize(f->FunctionTableSymbols.size(), nullptr);
-	f->PropertyTable.resize(f->PropertyTableSymbols.size(), -1);
+	f->PropertyTable.resize(f->PropertyTableSymbols.size());
 	f->TypeTable.resize(f->TypeTableSymbols.size(), VariableType::Undefined);
 	f->GlobalTable.resize(f->GlobalTableSymbols.size(), nullptr);
 
 	f->StringTable.reserve(StringList.size());
 	for (auto& str : StringList) {
-		f->StringTable.emplace_back(String::GetAllocator()->Make(str.c_str()));
+		auto literal = String::GetAllocator()->Make(str.c_str());
+		literal->MakeLiteral();
+		f->StringTable.emplace_back(literal);
 	}
 	StringList.clear();
+	f->BuildNumberConstants();
 
 	f->RegisterCount = MaxRegister + 1;
 	s->Resolved = true;
@@ -2188,6 +2210,8 @@ void ASTWalker::HandleInit()
 	op.in1 = 0;
 	InstructionList.emplace_back(op);
 
+	FuseInstructions();
+
 	InitFunction->Bytecode.resize(InstructionList.size());
 	for (size_t i = 0; i < InstructionList.size(); i++) {
 		InitFunction->Bytecode[i] = InstructionList[i].data;
@@ -2202,15 +2226,18 @@ void ASTWalker::HandleInit()
 #endif // DEBUG
 
 	InitFunction->FunctionTable.resize(InitFunction->FunctionTableSymbols.size(), nullptr);
-	InitFunction->PropertyTable.resize(InitFunction->PropertyTableSymbols.size(), -1);
+	InitFunction->PropertyTable.resize(InitFunction->PropertyTableSymbols.size());
 	InitFunction->TypeTable.resize(InitFunction->TypeTableSymbols.size(), VariableType::Undefined);
 	InitFunction->GlobalTable.resize(InitFunction->GlobalTableSymbols.size(), nullptr);
 
 	InitFunction->StringTable.reserve(StringList.size());
 	for (auto& str : StringList) {
-		InitFunction->StringTable.emplace_back(String::GetAllocator()->Make(str.c_str()));
+		auto literal = String::GetAllocator()->Make(str.c_str());
+		literal->MakeLiteral();
+		InitFunction->StringTable.emplace_back(literal);
 	}
 	StringList.clear();
+	InitFunction->BuildNumberConstants();
 
 	InitFunction->RegisterCount = MaxRegister + 1;
 	InstructionList.clear();
@@ -2243,3 +2270,67 @@ void ASTWalker::PlaceBreaks(Node* n, size_t start, size_t end)
 		}
 	}
 }
+
+// Replaces the first instruction of common pairs with a superinstruction that also runs the second one.
+// The second instruction is left in place and skipped, so jumps and debug lines stay valid without fixups.
+void ASTWalker::FuseInstructions()
+{
+	std::vector<int> breaks;
+	if (HasDebug && CurrentDebugFunction) {
+		for (auto point : BreakPoints) {
+			breaks.push_back(CurrentDebugFunction->GetInstructionForLine(point));
+		}
+	}
+
+	for (size_t i = 0; i < InstructionList.size(); i += InstructionWidth(InstructionList[i].code)) {
+		auto& head = InstructionList[i];
+		size_t next = i + InstructionWidth(head.code);
+		if (next >= InstructionList.size()) break;
+		// Breakpoint needs to stop on the second instruction
+		if (std::find(breaks.begin(), breaks.end(), (int)next) != breaks.end()) continue;
+
+		auto& tail = InstructionList[next];
+		OpCodes fused = head.code;
+		switch (head.code)
+		{
+		case OpCodes::Less:
+		case OpCodes::LessEqual:
+		case OpCodes::Greater:
+		case OpCodes::GreaterEqual: {
+			if (tail.code != OpCodes::JumpNeg || tail.target != head.target) break;
+			switch (head.code)
+			{
+			case OpCodes::Less: fused = OpCodes::LessJumpNeg; break;
+			case OpCodes::LessEqual: fused = OpCodes::LessEqualJumpNeg; break;
+			case OpCodes::Greater: fused = OpCodes::GreaterJumpNeg; break;
+			default: fused = OpCodes::GreaterEqualJumpNeg; break;
+			}
+		} break;
+		case OpCodes::LoadNumber: {
+			if (tail.in2 != head.target) break;
+			if (tail.code == OpCodes::NumAdd) fused = OpCodes::LoadNumberNumAdd;
+			else if (tail.code == OpCodes::NumSub) fused = OpCodes::LoadNumberNumSub;
+		} break;
+		case OpCodes::LoadImmediate: {
+			if (tail.in2 != head.target) break;
+			if (tail.code == OpCodes::NumAdd) fused = OpCodes::LoadImmediateNumAdd;
+			else if (tail.code == OpCodes::NumSub) fused = OpCodes::LoadImmediateNumSub;
+		} break;
+		case OpCodes::LoadProperty: {
+			if (tail.code == OpCodes::CallSymbol && next + 1 < InstructionList.size() && InstructionList[next + 1].target == head.target) {
+				fused = OpCodes::LoadPropertyCallSymbol;
+			}
+		} break;
+		case OpCodes::Copy: {
+			if (tail.code == OpCodes::CallFunction) fused = OpCodes::CopyCallFunction;
+		} break;
+		default:
+			break;
+		}
+
+		if (fused != head.code) {
+			head.code = fused;
+			i = next;
+		}
+	}
+}
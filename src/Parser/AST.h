@@ -144,6 +144,7 @@ private:
 	}
 
 	void PlaceBreaks(Node* n, size_t start, size_t end);
+	void FuseInstructions();
 };
 
 void TypeConverter(NodeDataType& n, const TokenHolder& h);
@@ -0,0 +1,193 @@
+#pragma once
+#include "EMIDev/Variable.h"
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Parks the thread while the word holds the value. On Linux the futex is used directly, std::atomic
+// wait goes through a shared waiter table first which made waiting for a result noticeably slower.
+inline void FutexWait(std::atomic<uint32_t>& word, uint32_t value)
+{
+#ifdef __linux__
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE, value, nullptr, nullptr, 0);
+#else
+	word.wait(value, std::memory_order_acquire);
+#endif
+}
+
+inline void FutexWake(std::atomic<uint32_t>& word, bool all)
+{
+#ifdef __linux__
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, all ? INT32_MAX : 1, nullptr, nullptr, 0);
+#else
+	if (all) word.notify_all();
+	else word.notify_one();
+#endif
+}
+
+/**
+
+Return values of queued calls. A handle is the slot index and the slot generation, the generation
+is bumped when the result is taken so a stale handle never reads a later call's value.
+
+Slots are allocated in chunks that are never freed, free slots are kept in a tagged lock-free stack.
+Waiting for a result parks on the slot state word. A slot whose handle is discarded before the
+result is taken is freed when the call completes.
+
+*/
+class ResultSlots
+{
+public:
+	ResultSlots() : FreeHead(Empty), ChunkCount(0) {
+		for (auto& chunk : Chunks) chunk.store(nullptr, std::memory_order_relaxed);
+	}
+
+	~ResultSlots() {
+		for (auto& chunk : Chunks) delete[] chunk.load(std::memory_order_relaxed);
+	}
+
+	static constexpr size_t Invalid = (size_t)-1;
+
+	// Reserves a slot for a call, the handle is passed to Complete and Take.
+	// Returns Invalid once every slot is waiting for its result to be taken
+	size_t Acquire() {
+		uint32_t index;
+		while (!Pop(index)) {
+			if (!Grow()) return Invalid;
+		}
+		Slot& slot = Get(index);
+		slot.State.store(Pending, std::memory_order_relaxed);
+		return ((size_t)slot.Generation.load(std::memory_order_relaxed) << 32) | index;
+	}
+
+	void Complete(size_t handle, Variable&& value) {
+		Slot& slot = Get((uint32_t)handle);
+		slot.Value = std::move(value);
+		uint32_t state = Pending;
+		if (!slot.State.compare_exchange_strong(state, Ready, std::memory_order_acq_rel)) {
+			// Nobody will take the result
+			Release(slot, (uint32_t)handle);
+			return;
+		}
+		FutexWake(slot.State, true);
+	}
+
+	// The result will not be taken, the slot is freed now or when the call completes
+	void Discard(size_t handle) {
+		Slot* slot = Find(handle);
+		if (!slot) return;
+
+		uint32_t state = Pending;
+		if (slot->State.compare_exchange_strong(state, Discarded, std::memory_order_acq_rel)) return;
+		if (state == Ready) {
+			Release(*slot, (uint32_t)handle);
+		}
+	}
+
+	bool IsReady(size_t handle) {
+		Slot* slot = Find(handle);
+		return slot && slot->State.load(std::memory_order_acquire) == Ready;
+	}
+
+	// Waits for the result and frees the slot, stale or invalid handles return undefined
+	Variable Take(size_t handle) {
+		Slot* slot = Find(handle);
+		if (!slot) return {};
+
+		uint32_t state = slot->State.load(std::memory_order_acquire);
+		while (state != Ready) {
+			FutexWait(slot->State, state);
+			state = slot->State.load(std::memory_order_acquire);
+		}
+
+		Variable value = std::move(slot->Value);
+		Release(*slot, (uint32_t)handle);
+		return value;
+	}
+
+private:
+	enum : uint32_t { Free, Pending, Ready, Discarded };
+
+	struct Slot
+	{
+		std::atomic<uint32_t> State{ Free };
+		// Starts from 1 so a zero handle is never valid
+		std::atomic<uint32_t> Generation{ 1 };
+		std::atomic<uint32_t> NextFree{ 0 };
+		Variable Value;
+	};
+
+	static constexpr uint32_t ChunkShift = 10;
+	static constexpr uint32_t ChunkSize = 1 << ChunkShift;
+	static constexpr uint32_t MaxChunks = 1024;
+	// Free stack head, a tag in the upper half prevents ABA
+	static constexpr uint64_t Empty = 0xffffffff;
+
+	Slot& Get(uint32_t index) {
+		return Chunks[index >> ChunkShift].load(std::memory_order_acquire)[index & (ChunkSize - 1)];
+	}
+
+	void Release(Slot& slot, uint32_t index) {
+		slot.Value = Variable();
+		slot.Generation.fetch_add(1, std::memory_order_relaxed);
+		slot.State.store(Free, std::memory_order_relaxed);
+		Push(index);
+	}
+
+	Slot* Find(size_t handle) {
+		uint32_t index = (uint32_t)handle;
+		if ((index >> ChunkShift) >= ChunkCount.load(std::memory_order_acquire)) return nullptr;
+		Slot& slot = Get(index);
+		if (slot.Generation.load(std::memory_order_relaxed) != (uint32_t)(handle >> 32)) return nullptr;
+		if (slot.State.load(std::memory_order_relaxed) == Free) return nullptr;
+		return &slot;
+	}
+
+	bool Pop(uint32_t& index) {
+		uint64_t head = FreeHead.load(std::memory_order_acquire);
+		while (true) {
+			uint32_t top = (uint32_t)head;
+			if (top == (uint32_t)Empty) return false;
+			uint32_t next = Get(top).NextFree.load(std::memory_order_relaxed);
+			uint64_t updated = ((head >> 32) + 1) << 32 | next;
+			if (FreeHead.compare_exchange_weak(head, updated, std::memory_order_acquire, std::memory_order_acquire)) {
+				index = top;
+				return true;
+			}
+		}
+	}
+
+	void Push(uint32_t index) {
+		uint64_t head = FreeHead.load(std::memory_order_relaxed);
+		while (true) {
+			Get(index).NextFree.store((uint32_t)head, std::memory_order_relaxed);
+			uint64_t updated = ((head >> 32) + 1) << 32 | index;
+			if (FreeHead.compare_exchange_weak(head, updated, std::memory_order_release, std::memory_order_relaxed)) return;
+		}
+	}
+
+	bool Grow() {
+		std::unique_lock lk(GrowLock);
+		// Another thread may have grown the table while this one waited
+		if ((uint32_t)FreeHead.load(std::memory_order_acquire) != (uint32_t)Empty) return true;
+		uint32_t chunk = ChunkCount.load(std::memory_order_relaxed);
+		if (chunk == MaxChunks) return false;
+		Chunks[chunk].store(new Slot[ChunkSize], std::memory_order_release);
+		ChunkCount.store(chunk + 1, std::memory_order_release);
+		for (uint32_t i = ChunkSize; i > 0; i--) {
+			Push(chunk * ChunkSize + i - 1);
+		}
+		return true;
+	}
+
+	std::atomic<uint64_t> FreeHead;
+	std::atomic<uint32_t> ChunkCount;
+	std::atomic<Slot*> Chunks[MaxChunks];
+	std::mutex GrowLock;
+};
@@ -5,6 +5,7 @@
 #include "Objects/StringObject.h"
 #include "Objects/ArrayObject.h"
 #include "Objects/FunctionObject.h"
+#include "CycleCollector.h"
 #include <math.h>
 #include <filesystem>
 #include <fstream>
@@ -12,51 +13,76 @@
 #include "ModuleLoader.h"
 #include "Parser/AST.h"
 
-VM::VM()
+VM::VM() : CallQueue(CallQueueSize)
 {
 	Parser::InitializeParser();
 	auto counter = std::thread::hardware_concurrency();
 	CompileRunning = true;
+	InstructionBudget = 0;
+	InterruptEpoch = 0;
+	TimersRunning = true;
 	Paused = false;
 
 	// @todo: This should also happen during runtime, not only in init
 	GlobalSymbols.Table.insert(IntrinsicFunctions.Table.begin(), IntrinsicFunctions.Table.end());
 	GlobalSymbols.Table.insert(HostFunctions().Table.begin(), HostFunctions().Table.end());
 
+	static std::atomic<uint64_t> VMCounter = 0;
+	Id = ++VMCounter;
+
 	VMRunning = true;
+	RunnerCount = 0;
+	RunnerPool.reserve(counter / 2);
 	for (uint32_t i = 0; i < counter / 2; i++) {
 		ParserPool.emplace_back(Parser::ThreadedParse, this);
 		RunnerPool.emplace_back(new Runner(this));
+		RunnerCount.store(RunnerPool.size(), std::memory_order_release);
 	}
-
-	GarbageCollector = new std::thread(&VM::GarbageCollect, this);
 }
 
 VM::~VM()
 {
-	while (!Units.empty()) {
-		RemoveUnit(Units.begin()->first);
-	}
-
-	GlobalSymbols.Table.clear();
-
 	CompileRunning = false;
 	VMRunning = false;
 	QueueNotify.notify_all();
-	CallQueueNotify.notify_all();
 	for (auto& t : ParserPool) {
 		t.join();
 	}
+	// Stopped before the runners, resumed calls could not be queued once they have stopped
+	{
+		std::unique_lock lk(TimerMutex);
+		TimersRunning = false;
+	}
+	TimerNotify.notify_all();
+	if (TimerThread.joinable()) TimerThread.join();
 	for (auto& t : RunnerPool) {
 		t->SetRunning(false);
 	}
-	CallQueueNotify.notify_all();
+	WorkNotify.NotifyAll();
+	// Runners may steal from each other until all of them have stopped
 	for (auto& t : RunnerPool) {
 		t->Join();
+	}
+	for (auto& t : RunnerPool) {
 		delete t;
 	}
-	GarbageCollector->join();
-	delete GarbageCollector;
+	for (auto& [thread, runner] : InlineRunners) {
+		delete runner;
+	}
+	InlineRunners.clear();
+	DropParked();
+	CallRequest* request = nullptr;
+	while (CallQueue.pop(request)) {
+		delete request;
+	}
+
+	// Calls still running used the functions of the units until the runners stopped
+	while (!Units.empty()) {
+		RemoveUnit(Units.begin()->first);
+	}
+
+	GlobalSymbols.Table.clear();
+
 	Parser::ReleaseParser();
 }
 
@@ -118,7 +144,121 @@ void VM::CompileAST(const char* name, Node* ast)
 
 void VM::Interrupt()
 {
+	InterruptEpoch.fetch_add(1, std::memory_order_acq_rel);
+	for (auto& runner : RunnerPool) {
+		runner->Interrupt();
+	}
+	{
+		std::unique_lock lk(InlineMutex);
+		for (auto& [thread, runner] : InlineRunners) {
+			runner->Interrupt();
+		}
+	}
+	DropParked();
+}
+
+void VM::DropParked()
+{
+	std::vector<CallRequest*> parked;
+	{
+		std::unique_lock lk(TimerMutex);
+		while (!Timers.empty()) {
+			parked.push_back(Timers.top().Request);
+			Timers.pop();
+		}
+	}
+	{
+		std::unique_lock lk(EventMutex);
+		for (auto& [name, event] : Events) {
+			parked.insert(parked.end(), event.Calls.begin(), event.Calls.end());
+			event.Calls.clear();
+		}
+	}
+	{
+		CollectorScope scope;
+		for (auto request : parked) {
+			Results.Complete(request->ResultHandle, Variable());
+			delete request;
+		}
+	}
+	if (!parked.empty()) {
+		gRuntimeWarn() << "Script interrupted";
+	}
+}
+
+void VM::ParkTimer(CallRequest* request, std::chrono::steady_clock::time_point until)
+{
+	std::unique_lock lk(TimerMutex);
+	if (!TimersRunning) {
+		lk.unlock();
+		Results.Complete(request->ResultHandle, Variable());
+		delete request;
+		return;
+	}
+	if (!TimerThread.joinable()) {
+		TimerThread = std::thread{ &VM::RunTimers, this };
+	}
+	Timers.push({ until, request });
+	TimerNotify.notify_one();
+}
+
+void VM::RunTimers()
+{
+	std::unique_lock lk(TimerMutex);
+	while (TimersRunning) {
+		if (Timers.empty()) {
+			TimerNotify.wait(lk);
+			continue;
+		}
+		auto until = Timers.top().Until;
+		if (std::chrono::steady_clock::now() < until) {
+			TimerNotify.wait_until(lk, until);
+			continue;
+		}
+		CallRequest* request = Timers.top().Request;
+		Timers.pop();
+		lk.unlock();
+		Submit(request);
+		lk.lock();
+	}
+}
+
+uint64_t VM::GetEventEpoch(const std::string& name)
+{
+	std::unique_lock lk(EventMutex);
+	return Events[name].Epoch;
+}
 
+void VM::ParkEvent(CallRequest* request, const std::string& name, uint64_t epoch)
+{
+	std::unique_lock lk(EventMutex);
+	auto& event = Events[name];
+	if (event.Epoch == epoch) {
+		event.Calls.push_back(request);
+		return;
+	}
+	request->Arguments[request->ResumeRegister] = event.Value;
+	lk.unlock();
+	Submit(request);
+}
+
+size_t VM::SignalEvent(const char* name, const InternalValue& value)
+{
+	CollectorScope scope;
+	Variable var = CopyToVM(value);
+	std::vector<CallRequest*> calls;
+	{
+		std::unique_lock lk(EventMutex);
+		auto& event = Events[name];
+		event.Epoch++;
+		event.Value = var;
+		calls.swap(event.Calls);
+	}
+	for (auto request : calls) {
+		request->Arguments[request->ResumeRegister] = var;
+		Submit(request);
+	}
+	return calls.size();
 }
 
 std::string VM::FindLibrary(const char*) const
@@ -216,7 +356,7 @@ void* VM::GetFunctionID(const std::string& id)
 	return 0;
 }
 
-size_t VM::CallFunction(FunctionHandle handle, const std::span<InternalValue>& args)
+size_t VM::CallFunction(FunctionHandle handle, const std::span<InternalValue>& args, size_t budget)
 {
 	FunctionTable* table = (FunctionTable*)(void*)handle;
 
@@ -227,61 +367,187 @@ size_t VM::CallFunction(FunctionHandle handle, const std::span<InternalValue>& a
 
 	FunctionSymbol* sym = table->GetFirstFitting((int)args.size());
 
-	if (sym->Type != FunctionType::User) {
+	if (!sym || sym->Type != FunctionType::User || !sym->Local) {
 		gRuntimeWarn() << "Cannot call non-script function"; //@todo: Make this possible
 		return (size_t)-1;
 	}
 
-	return DirectCallFunction(sym->Local, sym->Signature.Arguments, args);
+	return DirectCallFunction(sym->Local, sym->Signature.Arguments, args, budget == FunctionHandle::DefaultBudget ? InstructionBudget.load(std::memory_order_relaxed) : budget);
 }
 
-size_t VM::DirectCallFunction(ScriptFunction* fn, const std::vector<VariableType>& argTypes, const std::span<InternalValue>& args)
+size_t VM::DirectCallFunction(ScriptFunction* fn, const std::vector<VariableType>& argTypes, const std::span<InternalValue>& args, size_t budget)
 {
 	if (!fn) {
 		gRuntimeWarn() << "Invalid function handle";
 		return (size_t)-1;
 	}
 
-	CallObject& call = CallQueue.emplace(fn);
+	size_t handle = Results.Acquire();
+	if (handle == ResultSlots::Invalid) {
+		gRuntimeError() << "Too many results waiting to be taken, call to " << fn->Name << " failed";
+		return (size_t)-1;
+	}
+
+	CollectorScope scope;
+	CallRequest* call = new CallRequest(fn);
+	call->Budget = budget;
+	call->ResultHandle = handle;
 
-	call.Arguments.reserve(args.size());
+	call->Arguments.reserve(args.size());
 	for (size_t i = 0; i < argTypes.size() && i < args.size(); i++) {
 		auto val = CopyToVM(args[i]);
 		if (argTypes[i] == val.getType() || argTypes[i] == VariableType::Undefined) {
-			call.Arguments.push_back(val);
+			call->Arguments.push_back(std::move(val));
 		}
 	}
 
-	size_t idx = 0;
-	if (ReturnFreeList.empty()) {
-		auto& promise = ReturnPromiseValues.emplace_back();
-		ReturnValues.push_back(promise.get_future());
-		idx = ReturnValues.size() - 1;
-		call.PromiseIndex = idx;
+	Submit(call);
+
+	return handle;
+}
+
+InternalValue VM::CallFunctionInline(FunctionHandle handle, const std::span<InternalValue>& args)
+{
+	FunctionTable* table = (FunctionTable*)(void*)handle;
+
+	if (!table) {
+		gRuntimeWarn() << "Invalid function handle";
+		return {};
 	}
-	else {
-		idx = ReturnFreeList.back();
-		ReturnFreeList.pop_back();
-		call.PromiseIndex = idx;
-		ReturnPromiseValues[idx] = std::promise<Variable>();
-		ReturnValues[idx] = ReturnPromiseValues[idx].get_future();
+
+	FunctionSymbol* sym = table->GetFirstFitting((int)args.size());
+
+	if (sym->Type != FunctionType::User) {
+		gRuntimeWarn() << "Cannot call non-script function";
+		return {};
 	}
 
-	std::unique_lock lk(CallMutex);
-	CallQueueNotify.notify_one();
+	Runner* runner = GetInlineRunner();
+	if (runner->IsBusy()) {
+		// Host function called from an inline call, the thread's runner is in use so the call is queued
+		return GetReturnValue(DirectCallFunction(sym->Local, sym->Signature.Arguments, args, 0));
+	}
 
-	return idx;
+	CollectorScope scope;
+	Variable result = runner->CallInline(sym->Local, sym->Signature.Arguments, args);
+	return CopyToHost(result);
+}
+
+bool VM::CallBatch(FunctionHandle handle, size_t argCount, size_t count, const InternalValue* args, InternalValue* results)
+{
+	FunctionTable* table = (FunctionTable*)(void*)handle;
+
+	if (!table) {
+		gRuntimeWarn() << "Invalid function handle";
+		return false;
+	}
+
+	// The signature is checked once for the whole batch
+	FunctionSymbol* sym = table->GetFirstFitting((int)argCount);
+
+	if (!sym || sym->Type != FunctionType::User || !sym->Local) {
+		gRuntimeWarn() << "Cannot call non-script function";
+		return false;
+	}
+
+	if (count == 0) return true;
+	if ((!args && argCount > 0) || !results) {
+		gRuntimeWarn() << "Invalid batch buffers";
+		return false;
+	}
+
+	// Only the typed parameters are checked, an argument of the wrong type fails the whole batch
+	const auto& types = sym->Signature.Arguments;
+	size_t passed = std::min({ types.size(), argCount, (size_t)sym->Local->ArgCount });
+	std::vector<std::pair<size_t, VariableType>> typed;
+	for (size_t i = 0; i < passed; i++) {
+		if (types[i] != VariableType::Undefined) typed.push_back({ i, types[i] });
+	}
+	for (size_t call = 0; call < count; call++) {
+		const InternalValue* row = args + call * argCount;
+		for (auto& [index, type] : typed) {
+			if (TypeFromValue(row[index].getType()) != type) {
+				gRuntimeWarn() << "Batch call to " << sym->Local->Name << " failed, argument " << index << " of call " << call << " has the wrong type";
+				return false;
+			}
+		}
+	}
+
+	auto batch = std::make_shared<BatchCall>();
+	batch->FunctionPtr = sym->Local;
+	batch->Arguments = args;
+	batch->Results = results;
+	batch->ArgumentCount = argCount;
+	batch->PassedCount = passed;
+	batch->Count = count;
+	batch->Remaining.store(count, std::memory_order_relaxed);
+	// A few chunks for each runner so runners that finish early take over the rest
+	size_t runners = std::max<size_t>(RunnerCount.load(std::memory_order_relaxed), 1);
+	batch->ChunkSize = std::clamp<size_t>(count / (runners * 4), 1, BatchCall::MaxChunkSize);
+
+	CallRequest* call = new CallRequest(sym->Local);
+	call->Batch = batch;
+	Submit(call);
+
+	uint32_t done = batch->Done.load(std::memory_order_acquire);
+	while (done == 0) {
+		FutexWait(batch->Done, done);
+		done = batch->Done.load(std::memory_order_acquire);
+	}
+	return true;
+}
+
+Runner* VM::GetInlineRunner()
+{
+	struct InlineContext
+	{
+		uint64_t Owner = 0;
+		Runner* Context = nullptr;
+	};
+	// Last runner used by the thread, a thread usually calls into a single VM
+	thread_local InlineContext cache;
+	if (cache.Owner == Id) [[likely]] return cache.Context;
+
+	std::unique_lock lk(InlineMutex);
+	auto& runner = InlineRunners[std::this_thread::get_id()];
+	if (!runner) {
+		runner = new Runner(this, false);
+	}
+	cache.Owner = Id;
+	cache.Context = runner;
+	return runner;
+}
+
+void VM::Submit(CallRequest* request)
+{
+	while (!CallQueue.push(request)) {
+		WorkNotify.NotifyAll();
+		std::this_thread::yield();
+	}
+	WorkNotify.Notify();
 }
 
 InternalValue VM::GetReturnValue(size_t index)
 {
-	if (ReturnValues.size() <= index || ReturnFreeList.end() != std::find(ReturnFreeList.begin(), ReturnFreeList.end(), index)) return {};
-	Variable var = ReturnValues[index].get();
-	ReturnFreeList.push_back(index);
+	Variable var = Results.Take(index);
+	// Take may wait for the call to finish, the thread is only counted while the result is released
+	CollectorScope scope;
 	auto val = CopyToHost(var);
+	var = Variable();
 	return val;
 }
 
+bool VM::IsReturnReady(size_t index)
+{
+	return Results.IsReady(index);
+}
+
+void VM::DiscardReturnValue(size_t index)
+{
+	CollectorScope scope;
+	Results.Discard(index);
+}
+
 bool VM::WaitForResult(void* ptr)
 {
 	std::unique_lock lk(CompileMutex);
@@ -346,7 +612,7 @@ void VM::AddCompileUnit(const std::string& path, const SymbolTable& space, Scrip
 		Units[path].InitFunction = InitFunction;
 		//GlobalSymbols.Table.insert(space.Table.begin(), space.Table.end());
 	}
-	size_t idx = DirectCallFunction(InitFunction, {}, {});
+	size_t idx = DirectCallFunction(InitFunction, {}, {}, InstructionBudget.load(std::memory_order_relaxed));
 	GetReturnValue(idx);
 }
 
@@ -362,6 +628,8 @@ void VM::RemoveCompileUnitDebug(const std::string& path)
 
 void VM::RemoveUnit(const std::string& unit)
 {
+	// Globals of the unit are released
+	CollectorScope scope;
 	std::unique_lock lk(MergeMutex);
 	if (auto it = Units.find(unit); it != Units.end()) {
 		auto& u = it->second;
@@ -474,41 +742,234 @@ int VM::GetObjectFields(const std::string&)
 	return 0;
 }
 
-void VM::GarbageCollect()
+void VM::SetCollectorPacing(size_t allocations, size_t sliceSize)
 {
-	while (VMRunning) {
-
-		String::GetAllocator()->Free();
-		Array::GetAllocator()->Free();
-		FunctionObject::GetAllocator()->Free();
-		UserObject::GetAllocator()->Free();
-
-		std::this_thread::sleep_for(std::chrono::seconds(1));
-	}
+	String::GetAllocator()->SetPacing(allocations, sliceSize);
+	Array::GetAllocator()->SetPacing(allocations, sliceSize);
+	FunctionObject::GetAllocator()->SetPacing(allocations, sliceSize);
+	UserObject::SetPacing(allocations, sliceSize);
 }
 
-Runner::Runner(VM* vm) : Owner(vm)
+Runner::Runner(VM* vm, bool pooled) : Owner(vm)
 {
-	Registers.reserve(64);
-	CallStack.reserve(32);
 	Running = false;
+	Busy = false;
+	Signals = 0;
+	Fuel = INT64_MAX;
+	Victim = 0;
 	Paused = false;
 	TargetInstruction = 0;
 	CurrentInstruction = nullptr;
 	PauseDepth = 0;
 	Stepping = SteppingType::None;
 
-	RunThread = std::thread{ &Runner::Run, this };
+	Suspendable = false;
+	Pooled = pooled;
+	GetCycleCollector().Register(&Signals, static_cast<uint8_t>(RunnerSignal::Collect));
+	if (pooled) {
+		RunThread = std::thread{ &Runner::Run, this };
+	}
 }
 
 Runner::~Runner()
 {
-
+	GetCycleCollector().Unregister(&Signals);
+	CallRequest* request = nullptr;
+	while (Local.take(request)) {
+		delete request;
+	}
 }
 
 void Runner::Join()
 {
-	RunThread.join();
+	if (RunThread.joinable()) RunThread.join();
+}
+
+// Arguments are kept in the calling frame, the host function may run scripts calling other host functions
+static InternalValue CallHost(EMI::_internal_function* fn, const Variable* registers, int count)
+{
+	constexpr int StackArgs = 8;
+	InternalValue stackArgs[StackArgs];
+	std::vector<InternalValue> heapArgs;
+	InternalValue* args = stackArgs;
+	if (count > StackArgs) {
+		heapArgs.resize(count);
+		args = heapArgs.data();
+	}
+	for (int i = 0; i < count; ++i) {
+		args[i] = makeHostArg(registers[i]);
+	}
+	return (*fn)(count, args);
+}
+
+// Runner of the thread, a pooled runner's thread switches to its inline runner during synchronous calls
+static thread_local Runner* CurrentRunner = nullptr;
+
+Runner* Runner::Current()
+{
+	return CurrentRunner;
+}
+
+Variable Runner::CallInline(ScriptFunction* function, const std::vector<VariableType>& argTypes, const std::span<InternalValue>& args)
+{
+	Busy = true;
+	Running = true;
+	Clear(RunnerSignal::Interrupt);
+	Fuel = INT64_MAX;
+	Runner* previous = std::exchange(CurrentRunner, this);
+
+	Start(function, argTypes, args);
+	Finish();
+
+	CurrentRunner = previous;
+	Busy = false;
+	return std::move(InlineResult);
+}
+
+bool Runner::ParkYield()
+{
+	if (!Suspendable) return false;
+	Waiting.Type = WaitType::Yield;
+	Raise(RunnerSignal::Yield);
+	return true;
+}
+
+bool Runner::ParkTimer(std::chrono::steady_clock::time_point until)
+{
+	if (!Suspendable) return false;
+	Waiting.Type = WaitType::Timer;
+	Waiting.Until = until;
+	Raise(RunnerSignal::Yield);
+	return true;
+}
+
+bool Runner::ParkEvent(const std::string& name, Variable& out)
+{
+	if (!Suspendable) return false;
+	Waiting.Type = WaitType::Event;
+	Waiting.Event = name;
+	Waiting.Epoch = Owner->GetEventEpoch(name);
+	Waiting.Register = &out - CallStack.back().Base;
+	Raise(RunnerSignal::Yield);
+	return true;
+}
+
+void Runner::Start(ScriptFunction* function, const std::vector<VariableType>& argTypes, std::span<const InternalValue> args)
+{
+	CallObject& call = CallStack.push(function);
+	call.ResultHandle = InlineCall;
+	call.Base = Registers.reset();
+	call.Segment = Registers.current();
+
+	uint8_t reg = 0;
+	for (size_t i = 0; i < argTypes.size() && i < args.size() && reg < function->ArgCount; i++) {
+		auto val = CopyToVM(args[i]);
+		if (argTypes[i] == val.getType() || argTypes[i] == VariableType::Undefined) {
+			Registers[reg++] = std::move(val);
+		}
+	}
+}
+
+void Runner::Start(ScriptFunction* function, std::span<Variable> args)
+{
+	CallObject& call = CallStack.push(function);
+	call.ResultHandle = InlineCall;
+	call.Base = Registers.reset();
+	call.Segment = Registers.current();
+
+	for (size_t i = 0; i < args.size(); i++) {
+		Registers[i] = std::move(args[i]);
+	}
+}
+
+bool Runner::Finish()
+{
+	while (!CallStack.empty()) {
+		if (!Running || HasSignal(RunnerSignal::Interrupt)) {
+			Abort();
+			return false;
+		}
+		if (HasSignal(RunnerSignal::Collect)) {
+			Clear(RunnerSignal::Collect);
+			GetCycleCollector().Collect();
+		}
+		GetCycleCollector().Enter();
+#ifdef INCLUDE_DEBUGGER
+		// Only pooled runners are signaled by the debugger
+		if (HasSignal(RunnerSignal::Debug)) {
+			Execute<true>();
+			GetCycleCollector().Leave();
+			continue;
+		}
+#endif // INCLUDE_DEBUGGER
+		Execute<false>();
+		GetCycleCollector().Leave();
+	}
+	return true;
+}
+
+void Runner::RunBatch(const std::shared_ptr<BatchCall>& batch)
+{
+	BatchCall& b = *batch;
+	// Batched calls run to completion like synchronous ones
+	Fuel = INT64_MAX;
+	bool helped = false;
+	while (true) {
+		size_t start = b.Next.fetch_add(b.ChunkSize, std::memory_order_relaxed);
+		if (start >= b.Count) break;
+		size_t end = std::min(start + b.ChunkSize, b.Count);
+
+		// Another runner is asked to help while chunks are left, it asks the next one
+		if (!helped && end < b.Count) {
+			helped = true;
+			if (b.Workers.load(std::memory_order_relaxed) < Owner->RunnerCount.load(std::memory_order_relaxed)) {
+				b.Workers.fetch_add(1, std::memory_order_relaxed);
+				CallRequest* help = new CallRequest(b.FunctionPtr);
+				help->Batch = batch;
+				Local.push(help);
+				Owner->WorkNotify.Notify();
+			}
+		}
+
+		// The arguments of the chunk are converted in one pass, the calls move them to the registers
+		size_t passed = b.PassedCount;
+		BatchArguments.clear();
+		BatchArguments.reserve((end - start) * passed);
+		for (size_t i = start; i < end; i++) {
+			const InternalValue* row = b.Arguments + i * b.ArgumentCount;
+			for (size_t a = 0; a < passed; a++) {
+				BatchArguments.push_back(CopyToVM(row[a]));
+			}
+		}
+
+		for (size_t i = start; i < end; i++) {
+			Start(b.FunctionPtr, { BatchArguments.data() + (i - start) * passed, passed });
+			bool finished = Finish();
+			b.Results[i] = CopyToHost(InlineResult);
+			InlineResult = Variable();
+			if (!finished) {
+				// Interrupted, calls not started yet are dropped and return undefined
+				BatchArguments.clear();
+				for (size_t j = i + 1; j < end; j++) b.Results[j] = InternalValue();
+				size_t rest = std::min(b.Next.exchange(b.Count, std::memory_order_relaxed), b.Count);
+				for (size_t j = rest; j < b.Count; j++) b.Results[j] = InternalValue();
+				b.Finish(end - start + b.Count - rest);
+				return;
+			}
+		}
+		BatchArguments.clear();
+		b.Finish(end - start);
+	}
+}
+
+void Runner::SetResult(size_t handle, Variable&& value)
+{
+	if (handle == InlineCall) {
+		InlineResult = std::move(value);
+	}
+	else {
+		Owner->Results.Complete(handle, std::move(value));
+	}
 }
 
 void Runner::Pause(const uint32_t* ptr) {
@@ -519,6 +980,143 @@ void Runner::Pause(const uint32_t* ptr) {
 	Owner->RunnerNotify.wait(pauseLock, [this]() { return !Paused || (Owner->PausedRunner == this && Stepping != SteppingType::None); });
 }
 
+void Runner::Abort()
+{
+	while (!CallStack.empty()) {
+		auto& call = CallStack.back();
+		Registers.to(call.Base, call.Segment);
+		Registers.destroy(call.FunctionPtr->RegisterCount);
+		if (CallStack.size() == 1) {
+			SetResult(call.ResultHandle, Variable());
+		}
+		CallStack.pop();
+	}
+	Clear(RunnerSignal::Interrupt);
+	Clear(RunnerSignal::Yield);
+	Waiting.Type = WaitType::None;
+	gRuntimeWarn() << "Script interrupted";
+}
+
+void Runner::Save(CallRequest* request)
+{
+	// Tail calls may have replaced the first function
+	request->FunctionPtr = CallStack[0].FunctionPtr;
+	request->Frames.reserve(CallStack.size());
+
+	for (size_t i = 0; i < CallStack.size(); i++) {
+		auto& call = CallStack[i];
+		request->Frames.push_back({ call.FunctionPtr, (size_t)(call.Ptr - call.FunctionPtr->Bytecode.data()), call.CallingInstruction });
+		// Windows overlap with the callee arguments, so values are copied rather than moved
+		for (size_t r = 0; r < call.FunctionPtr->RegisterCount; r++) {
+			request->Arguments.push_back(call.Base[r]);
+		}
+	}
+	while (!CallStack.empty()) {
+		auto& call = CallStack.back();
+		Registers.to(call.Base, call.Segment);
+		Registers.destroy(call.FunctionPtr->RegisterCount);
+		CallStack.pop();
+	}
+}
+
+void Runner::Suspend(CallRequest* request)
+{
+	Save(request);
+	// Requeued at the back of the shared queue so waiting calls get their turn
+	if (!Owner->CallQueue.push(request)) {
+		Local.push(request);
+	}
+	Owner->WorkNotify.Notify();
+}
+
+void Runner::Park(CallRequest* request)
+{
+	WaitType type = std::exchange(Waiting.Type, WaitType::None);
+	if (type == WaitType::Timer) {
+		Save(request);
+		Owner->ParkTimer(request, Waiting.Until);
+	}
+	else if (type == WaitType::Event) {
+		size_t registers = CallStack.back().FunctionPtr->RegisterCount;
+		Save(request);
+		// The waiting frame is saved last
+		request->ResumeRegister = request->Arguments.size() - registers + Waiting.Register;
+		Owner->ParkEvent(request, Waiting.Event, Waiting.Epoch);
+	}
+	else {
+		Suspend(request);
+	}
+}
+
+bool Runner::FindWork(CallRequest*& request)
+{
+	if (Local.take(request)) return true;
+
+	if (Owner->CallQueue.pop(request)) {
+		// A few more are taken to touch the shared queue less often, idle runners steal them
+		CallRequest* extra = nullptr;
+		size_t moved = 0;
+		for (; moved < BatchSize - 1 && Owner->CallQueue.pop(extra); moved++) {
+			Local.push(extra);
+		}
+		if (moved > 0) Owner->WorkNotify.Notify();
+		return true;
+	}
+
+	size_t count = Owner->RunnerCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; i++) {
+		Runner* victim = Owner->RunnerPool[Victim++ % count];
+		if (victim != this && victim->Local.steal(request)) return true;
+	}
+	return false;
+}
+
+void Runner::Restore(CallRequest& request)
+{
+	// Windows are restored next to each other, the overlap with the caller is only needed to pass the arguments
+	Variable* base = Registers.reset();
+	size_t value = 0;
+	for (size_t i = 0; i < request.Frames.size(); i++) {
+		auto& frame = request.Frames[i];
+		if (i > 0) {
+			base = Registers.open(base + request.Frames[i - 1].FunctionPtr->RegisterCount, frame.FunctionPtr->RegisterCount, 0);
+		}
+
+		CallObject& call = CallStack.push(frame.FunctionPtr);
+		call.ResultHandle = request.ResultHandle;
+		call.Ptr = frame.FunctionPtr->Bytecode.data() + frame.Instruction;
+		call.CallingInstruction = frame.CallingInstruction;
+		call.Base = base;
+		call.Segment = Registers.current();
+
+		for (size_t r = 0; r < frame.FunctionPtr->RegisterCount; r++) {
+			base[r] = std::move(request.Arguments[value++]);
+		}
+	}
+	request.Frames.clear();
+}
+
+void Runner::Reenter(CallObject* current, ScriptFunction* function, uint8_t args, uint8_t count)
+{
+	for (uint8_t i = 0; i < count; i++) {
+		Registers[i] = std::move(Registers[args + i]);
+	}
+	for (size_t i = count; i < current->FunctionPtr->RegisterCount; i++) {
+		Registers[i].setUndefined();
+	}
+
+	current->FunctionPtr = function;
+	current->Ptr = function->Bytecode.data();
+	current->End = current->Ptr + function->Bytecode.size();
+	current->Base = Registers.open(current->Base, function->RegisterCount, count);
+	current->Segment = Registers.current();
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+// Labels as values are available, each handler jumps directly to the next one
+#define EMI_COMPUTED_GOTO
+#endif
+
 #define TARGET(Op) Op: 
 #define Error() gRuntimeError() << current->FunctionPtr->Name << " (" << FunctionDebug->GetLineForInstruction(int(current->Ptr - current->FunctionPtr->Bytecode.data())) << "):  "
 #define Warn() gRuntimeWarn() << current->FunctionPtr->Name << " (" << FunctionDebug->GetLineForInstruction(int(current->Ptr - current->FunctionPtr->Bytecode.data())) << "):  "
@@ -526,6 +1124,9 @@ void Runner::Pause(const uint32_t* ptr) {
 void Runner::Run()
 {
 	Running = true;
+	Suspendable = true;
+	CurrentRunner = this;
+	CallRequest* request = nullptr;
 	while (Running) {
 
 		if (Owner->PausedRunner == this) {
@@ -533,744 +1134,1015 @@ void Runner::Run()
 			Owner->Resume();
 		}
 
-		{
-			std::unique_lock lk(Owner->CallMutex);
-			Owner->CallQueueNotify.wait(lk, [&]() {return !Owner->CallQueue.empty() || !Running; });
-			if (!Running) return;
+		if (!FindWork(request)) {
+			uint32_t key = Owner->WorkNotify.PrepareWait();
+			if (!Running) {
+				Owner->WorkNotify.CancelWait();
+				return;
+			}
+			if (!FindWork(request)) {
+				Owner->WorkNotify.Wait(key);
+				continue;
+			}
+			Owner->WorkNotify.CancelWait();
+		}
+
+		// Held until the request is done with, collections run between requests or at safepoints
+		CollectorScope scope;
 
-			CallStack.push_back(Owner->CallQueue.front());
-			Owner->CallQueue.pop();
+		if (request->FunctionPtr->Bytecode.size() == 0) {
+			delete request;
+			break;
 		}
 
-		bool hasReturn = false;
-		bool interrupt = true;
-		CallObject* current = &CallStack.back();
-		current->Ptr = current->FunctionPtr->Bytecode.data();
-		current->End = current->Ptr + current->FunctionPtr->Bytecode.size();
-		current->StackOffset = 0;
-		auto FunctionDebug = Owner->DebugInformation.GetFunction(current->FunctionPtr->Name);
+		// Interrupts only apply to calls that were running when it was requested
+		Clear(RunnerSignal::Interrupt);
 
-		if (current->FunctionPtr->Bytecode.size() == 0) break;
+		if (request->Batch) {
+			Suspendable = false;
+			RunBatch(request->Batch);
+			Suspendable = true;
+			delete request;
+			request = nullptr;
+			continue;
+		}
 
-		Registers.reserve(current->FunctionPtr->RegisterCount);
-		Registers.to(0);
+		if (!request->Frames.empty() && request->Epoch != Owner->InterruptEpoch.load(std::memory_order_acquire)) {
+			// Out of budget or parked when the interrupt was requested
+			Owner->Results.Complete(request->ResultHandle, Variable());
+			gRuntimeWarn() << "Script interrupted";
+			delete request;
+			request = nullptr;
+			continue;
+		}
+
+		Fuel = request->Budget ? (int64_t)request->Budget : INT64_MAX;
+		if (!request->Frames.empty()) {
+			Restore(*request);
+		}
+		else {
+			request->Epoch = Owner->InterruptEpoch.load(std::memory_order_acquire);
+			CallObject& call = CallStack.push(request->FunctionPtr);
+			call.ResultHandle = request->ResultHandle;
+			call.Base = Registers.reset();
+			call.Segment = Registers.current();
+
+			for (size_t i = 0; i < call.FunctionPtr->ArgCount && i < request->Arguments.size(); i++) {
+				Registers[i] = std::move(request->Arguments[i]);
+			}
+		}
+		request->Arguments.clear();
 
-		for (size_t i = 0; i < current->FunctionPtr->ArgCount && i < current->Arguments.size(); i++) {
-			Registers[i] = current->Arguments[i];
+		// The loops return when the call finishes or the debugger attaches/detaches,
+		// the call stack and registers are left as they are so the other loop can continue
+		while (Running && !CallStack.empty()) {
+			if (HasSignal(RunnerSignal::Interrupt)) {
+				Abort();
+				break;
+			}
+			if (HasSignal(RunnerSignal::Yield)) {
+				Clear(RunnerSignal::Yield);
+				Park(request);
+				request = nullptr;
+				break;
+			}
+			if (Fuel < 0) {
+				// The request is reused for the requeued call
+				Suspend(request);
+				request = nullptr;
+				break;
+			}
+			if (HasSignal(RunnerSignal::Collect)) {
+				Clear(RunnerSignal::Collect);
+				GetCycleCollector().Collect();
+			}
+			GetCycleCollector().Enter();
+#ifdef INCLUDE_DEBUGGER
+			if (HasSignal(RunnerSignal::Debug)) {
+				Execute<true>();
+				GetCycleCollector().Leave();
+				continue;
+			}
+#endif // INCLUDE_DEBUGGER
+			Execute<false>();
+			GetCycleCollector().Leave();
 		}
-		current->Arguments.clear();
+		delete request;
+		request = nullptr;
+	}
+}
 
-#define NUMS current->FunctionPtr->NumberTable.values()
-#define STRS current->FunctionPtr->StringTable
-		out:
-		while (interrupt && Running) {
+template <bool Debug>
+void Runner::Execute()
+{
+	CallObject* current = &CallStack.back();
+	auto FunctionDebug = Owner->DebugInformation.GetFunction(current->FunctionPtr->Name);
 
-		start: // @todo: maybe something better so we can exit whenever?
-			if (!Running) [[unlikely]] goto out;
+#define NUMS current->FunctionPtr->NumberConstants
+#define STRS current->FunctionPtr->StringTable
+#ifdef EMI_COMPUTED_GOTO
+#define X(x) &&x,
+	static const void* DispatchTable[] = {
+#include "Opcodes.h"
+	};
+#undef X
+#define DISPATCH() do { \
+	if constexpr (Debug) goto start; \
+	else { \
+		byte.data = LoadCodeWord(current->Ptr++); \
+		goto *DispatchTable[(uint8_t)byte.code]; \
+	} \
+} while (0)
+#else
+#define DISPATCH() do { if constexpr (Debug) goto start; else goto next; } while (0)
+#endif // EMI_COMPUTED_GOTO
+// Signals are only checked at backward jumps, calls and returns, straight-line code does not pay for them
+#define NUM_COMPARE(lhs, rhs, op) ((lhs).isInt() && (rhs).isInt() ? (lhs).asInt() op (rhs).asInt() : toNumber(lhs) op toNumber(rhs))
+
+// Fuel is charged with the instructions a backward jump repeats
+#define SAFEPOINT(cost) do { \
+	if constexpr (!Debug) { \
+		if (Signals.load(std::memory_order_relaxed)) [[unlikely]] return; \
+		if ((Fuel -= (cost)) < 0) [[unlikely]] return; \
+	} \
+} while (0)
+
+// Fetches the second instruction of a fused pair. A breakpoint set on it after fusing replaces the word,
+// the rest of the pair then runs unfused through the break
+#define FUSED_TAIL(op) do { \
+	(op).data = LoadCodeWord(current->Ptr); \
+	if ((op).code == OpCodes::Break) [[unlikely]] DISPATCH(); \
+	current->Ptr++; \
+} while (0)
+
+	Instruction byte;
+
+[[maybe_unused]] start:
+	if constexpr (Debug) {
 #ifdef INCLUDE_DEBUGGER
-			if (Paused) [[unlikely]] {
-				if (TargetInstruction == (uint32_t*)-1) {
-					std::unique_lock pauseLock(Owner->RunnerPauseMutex);
-					Owner->RunnerNotify.wait(pauseLock, [this]() { return !Paused || (Owner->PausedRunner == this && Stepping != SteppingType::None); });
-				}
-				else {
-					switch (Stepping)
-					{
-					case SteppingType::Step:
-						if (current->Ptr > TargetInstruction && PauseDepth == static_cast<int>(CallStack.size()))
-							Pause(current->Ptr);
-						break;
-					case SteppingType::Up:
-						if (PauseDepth > static_cast<int>(CallStack.size()))
-							Pause(current->Ptr);
-						break;
-					case SteppingType::Down:
-						if (PauseDepth < static_cast<int>(CallStack.size()) || current->Ptr > TargetInstruction)
-							Pause(current->Ptr);
-						break;
-					default:
+		if (Signals.load(std::memory_order_relaxed) != static_cast<uint8_t>(RunnerSignal::Debug)) return;
+		if (Paused) [[unlikely]] {
+			if (TargetInstruction == (uint32_t*)-1) {
+				std::unique_lock pauseLock(Owner->RunnerPauseMutex);
+				Owner->RunnerNotify.wait(pauseLock, [this]() { return !Paused || (Owner->PausedRunner == this && Stepping != SteppingType::None); });
+			}
+			else {
+				switch (Stepping)
+				{
+				case SteppingType::Step:
+					if (current->Ptr > TargetInstruction && PauseDepth == static_cast<int>(CallStack.size()))
 						Pause(current->Ptr);
-						break;
-					}
+					break;
+				case SteppingType::Up:
+					if (PauseDepth > static_cast<int>(CallStack.size()))
+						Pause(current->Ptr);
+					break;
+				case SteppingType::Down:
+					if (PauseDepth < static_cast<int>(CallStack.size()) || current->Ptr > TargetInstruction)
+						Pause(current->Ptr);
+					break;
+				default:
+					Pause(current->Ptr);
+					break;
 				}
 			}
-#endif
-			const Instruction& byte = *(Instruction*)current->Ptr++;
+		}
+#endif // INCLUDE_DEBUGGER
+	}
+	else {
+		if (Signals.load(std::memory_order_relaxed)) [[unlikely]] return;
+	}
+[[maybe_unused]] next:
+	byte.data = LoadCodeWord(current->Ptr++);
 
+execute:
+#ifdef EMI_COMPUTED_GOTO
+	goto *DispatchTable[(uint8_t)byte.code];
+#else
 #define X(x) case OpCodes::x: goto x;
-			switch (byte.code)
-			{
+	switch (byte.code)
+	{
 #include "Opcodes.h"
-			default: 
-			#ifdef _MSC_VER
-			__assume(0);
-			#endif
-			break;
-			}
+	default: 
+	#ifdef _MSC_VER
+	__assume(0);
+	#endif
+	break;
+	}
 #undef X
-				TARGET(Noop) goto start;
-				TARGET(Break) {
-					std::unique_lock lock(Owner->RunnerPauseMutex);
-					PauseDepth = (int)CallStack.size();
-					Owner->PausedRunner = this;
-					Owner->Pause();
-					CurrentInstruction = current->Ptr;
-					TargetInstruction = (uint32_t*)CurrentInstruction;
-				} goto out;
-
-				TARGET(JumpForward) {
-					current->Ptr += byte.param;
-				} goto start;	
-
-				TARGET(JumpBackward) {
-					current->Ptr -= byte.param;
-				} goto start;
-
-				TARGET(Jump) {
-					current->Ptr = &current->FunctionPtr->Bytecode.data()[byte.param];
-				} goto start;
-
-				TARGET(RangeFor) {
-
-					auto& index = Registers[byte.in1];
-					auto& cmp = Registers[byte.in2];
-
-					if (index.getType() != VariableType::Number) {
-						Error() << "Index type does not match the expression";
-						goto start;
-					}
-					index = index.as<double>() + 1.0;
-
-					bool result = false;
-					switch (cmp.getType())
-					{
-					case VariableType::Number: {
-						result = index.as<double>() < cmp.as<double>();
-					} break;
+#endif // EMI_COMPUTED_GOTO
+	TARGET(Noop) DISPATCH();
+	TARGET(Break) {
+#ifdef INCLUDE_DEBUGGER
+		// Breakpoints are patched into the bytecode, the fast loop hands over to the debug loop.
+		// Inline runners are not paused by the debugger, they only run the original instruction.
+		if (Pooled) {
+			if constexpr (!Debug) {
+				current->Ptr--;
+				Raise(RunnerSignal::Debug);
+				return;
+			}
+			{
+				std::unique_lock lock(Owner->RunnerPauseMutex);
+				PauseDepth = (int)CallStack.size();
+				Owner->PausedRunner = this;
+				Owner->Pause();
+			}
+			Pause(current->Ptr - 1);
+		}
+#endif // INCLUDE_DEBUGGER
+		byte.data = current->FunctionPtr->GetOriginalInstruction(current->Ptr - 1 - current->FunctionPtr->Bytecode.data());
+	} goto execute;
 
-					case VariableType::Array: {
-						result = index.as<double>() < cmp.as<Array>()->size();
-					} break;
+	TARGET(JumpForward) {
+		current->Ptr += byte.param;
+	} DISPATCH();	
 
-					default:
-						break;
-					}
+	TARGET(JumpBackward) {
+		current->Ptr -= byte.param;
+	} SAFEPOINT(byte.param); DISPATCH();
 
-					Registers[byte.target] = result;
-				} goto start;
+	// Used by continue, which can loop without reaching JumpBackward
+	TARGET(Jump) {
+		current->Ptr = &current->FunctionPtr->Bytecode.data()[byte.param];
+	} SAFEPOINT(1); DISPATCH();
 
-				TARGET(RangeForVar) {
-					const Instruction& data = *(Instruction*)current->Ptr++;
+	TARGET(RangeFor) {
 
-					auto& var = Registers[data.in1];
-					auto& index = Registers[byte.in1];
-					auto& cmp = Registers[byte.in2];
+		auto& index = Registers[byte.in1];
+		auto& cmp = Registers[byte.in2];
 
-					if (index.getType() != VariableType::Number) {
-						Error() << "Index type does not match the expression";
-						goto start;
-					}
-					index = index.as<double>() + 1.0;
-
-					bool result = false;
-					switch (cmp.getType())
-					{
-					case VariableType::Number: {
-						result = index.as<double>() < cmp.as<double>();
-						if (result) {
-							var = index;
-						}
-					} break;
+		if (index.isInt() && index.asInt() != INT32_MAX) [[likely]] {
+			index = index.asInt() + 1;
+		}
+		else if (index.isNumber()) {
+			index = index.as<double>() + 1.0;
+		}
+		else {
+			Error() << "Index type does not match the expression";
+			DISPATCH();
+		}
 
-					case VariableType::Array: {
-						result = index.as<double>() < cmp.as<Array>()->size();
-						if (result) {
-							var = cmp.as<Array>()->data()[static_cast<size_t>(index.as<double>())];
-						}
-					} break;
+		bool result = false;
+		switch (cmp.getType())
+		{
+		case VariableType::Number: {
+			result = NUM_COMPARE(index, cmp, <);
+		} break;
 
-					default:
-						break;
-					}
+		case VariableType::Array: {
+			result = toIndex(index) < cmp.as<Array>()->size();
+		} break;
 
-					Registers[byte.target] = result;
-				} goto start;
-
-				TARGET(LoadNumber) {
-					Registers[byte.target] = NUMS[byte.param];
-				} goto start;
-
-				TARGET(LoadImmediate) {
-					Registers[byte.target] = (int8_t)byte.param;
-				} goto start;
-
-				TARGET(LoadString) {
-					Registers[byte.target] = STRS[byte.param];
-				} goto start;
-
-				TARGET(LoadSymbol) {
-					auto& var = current->FunctionPtr->GlobalTable[byte.param];
-					if (var == nullptr) {
-						auto& name = current->FunctionPtr->GlobalTableSymbols[byte.param];
-						auto res = Owner->GlobalSymbols.FindName(name);
-						if (res.second) {
-							if (res.second->Type == SymbolType::Variable || res.second->Type == SymbolType::Static) {
-								var = res.second->SimpleVariable;
-							}
-							else if (res.second->Type == SymbolType::Function) {
-								auto f = res.second->Function;
-								if (f->FunctionVar.getType() == VariableType::Function) {
-									var = &f->FunctionVar;
-								}
-								else {
-									auto func = FunctionObject::GetAllocator()->Make(res.first, res.second->Function);
-									f->FunctionVar = func;
-									var = &f->FunctionVar;
-								}
-							}
-						}
-						else {
-							Warn() << "Variable does not exist: " << name;
-							goto start;
-						}	
-					}
+		default:
+			break;
+		}
 
-					Registers[byte.target] = *var;
+		Registers[byte.target] = result;
+	} DISPATCH();
 
-				} goto start;
+	TARGET(RangeForVar) {
+		const Instruction& data = *(Instruction*)current->Ptr++;
 
-				TARGET(StoreSymbol) {
-					auto& var = current->FunctionPtr->GlobalTable[byte.param];
-					if (var == nullptr) {
-						auto& name = current->FunctionPtr->GlobalTableSymbols[byte.param];
-						auto res = Owner->GlobalSymbols.FindName(name);
-						if (res.second && (res.second->Type == SymbolType::Variable || res.second->Type == SymbolType::Static)) {
-							var = res.second->SimpleVariable;
-						}
-						else {
-							Warn() << "Symbol does not exist: " << name;
-							goto start;
-						}
-					}
-					if (var->getType() == VariableType::Function) {
-						Warn() << "Cannot assign to functions";
-						goto start;
-					}
+		auto& var = Registers[data.in1];
+		auto& index = Registers[byte.in1];
+		auto& cmp = Registers[byte.in2];
 
-					*var = Registers[byte.target];
-				} goto start;
+		if (index.isInt() && index.asInt() != INT32_MAX) [[likely]] {
+			index = index.asInt() + 1;
+		}
+		else if (index.isNumber()) {
+			index = index.as<double>() + 1.0;
+		}
+		else {
+			Error() << "Index type does not match the expression";
+			DISPATCH();
+		}
 
-				TARGET(LoadProperty) {
-					const Instruction& data = *(Instruction*)current->Ptr++;
+		bool result = false;
+		switch (cmp.getType())
+		{
+		case VariableType::Number: {
+			result = NUM_COMPARE(index, cmp, <);
+			if (result) {
+				var = index;
+			}
+		} break;
+
+		case VariableType::Array: {
+			size_t idx = toIndex(index);
+			Array* arr = cmp.as<Array>();
+			result = idx < arr->size();
+			if (result) {
+				var = arr->get(idx);
+			}
+		} break;
 
-					Variable& prop = Registers[byte.in1];
-					int32_t& propertyIdx = current->FunctionPtr->PropertyTable[data.param];
-					if (propertyIdx == -1) {
-						auto& name = current->FunctionPtr->PropertyTableSymbols[data.param];
+		default:
+			break;
+		}
 
-						uint16_t idx;
-						if (!GetManager().GetPropertyIndex(idx, name, prop.getType())) {
-							propertyIdx = -1;
-							Error() << "Property not found: " << name.GetName();
-							Registers[byte.target].setUndefined();
-							goto start;
-						}
-						propertyIdx = idx;
+		Registers[byte.target] = result;
+	} DISPATCH();
+
+	TARGET(LoadNumber) {
+		Registers[byte.target] = NUMS[byte.param];
+	} DISPATCH();
+
+	TARGET(LoadImmediate) {
+		Registers[byte.target] = (int16_t)byte.param;
+	} DISPATCH();
+
+	TARGET(LoadString) {
+		Registers[byte.target] = STRS[byte.param];
+	} DISPATCH();
+
+	TARGET(LoadSymbol) {
+		auto& var = current->FunctionPtr->GlobalTable[byte.param];
+		if (var == nullptr) {
+			auto& name = current->FunctionPtr->GlobalTableSymbols[byte.param];
+			auto res = Owner->GlobalSymbols.FindName(name);
+			if (res.second) {
+				if (res.second->Type == SymbolType::Variable || res.second->Type == SymbolType::Static) {
+					var = res.second->SimpleVariable;
+				}
+				else if (res.second->Type == SymbolType::Function) {
+					auto f = res.second->Function;
+					if (f->FunctionVar.getType() == VariableType::Function) {
+						var = &f->FunctionVar;
 					}
-
-					if (prop.getType() > VariableType::Object) {
-						UserObject* ptr = prop.as<UserObject>();
-						if (ptr->size() <= propertyIdx) {
-							Error() << "Invalid property " << current->FunctionPtr->PropertyTableSymbols[data.param].GetName();
-							Registers[byte.target].setUndefined();
-							goto start;
-						}
-						Registers[byte.target] = (*ptr)[static_cast<uint16_t>(propertyIdx)];
+					else {
+						auto func = FunctionObject::GetAllocator()->Make(res.first, res.second->Function);
+						func->MakeImmortal();
+						f->FunctionVar = func;
+						var = &f->FunctionVar;
 					}
-				} goto start;
+				}
+			}
+			else {
+				Warn() << "Variable does not exist: " << name;
+				DISPATCH();
+			}	
+		}
 
-				TARGET(StoreProperty) {
-					const Instruction& data = *(Instruction*)current->Ptr++;
+		Registers[byte.target] = *var;
 
-					Variable& prop = Registers[byte.in1];
-					int32_t& propertyIdx = current->FunctionPtr->PropertyTable[data.param];
-					if (propertyIdx == -1) {
-						auto& name = current->FunctionPtr->PropertyTableSymbols[data.param];
+	} DISPATCH();
 
-						uint16_t idx;
-						if (!GetManager().GetPropertyIndex(idx, name, prop.getType())) {
-							propertyIdx = -1;
-							Error() << "Property not found: " << name.GetName();
-							goto start;
-						}
-						propertyIdx = idx;
-					}
+	TARGET(StoreSymbol) {
+		auto& var = current->FunctionPtr->GlobalTable[byte.param];
+		if (var == nullptr) {
+			auto& name = current->FunctionPtr->GlobalTableSymbols[byte.param];
+			auto res = Owner->GlobalSymbols.FindName(name);
+			if (res.second && (res.second->Type == SymbolType::Variable || res.second->Type == SymbolType::Static)) {
+				var = res.second->SimpleVariable;
+			}
+			else {
+				Warn() << "Symbol does not exist: " << name;
+				DISPATCH();
+			}
+		}
+		if (var->getType() == VariableType::Function) {
+			Warn() << "Cannot assign to functions";
+			DISPATCH();
+		}
 
-					if (prop.getType() > VariableType::Object) {
-						UserObject* ptr = prop.as<UserObject>();
-						if (ptr->size() <= propertyIdx) {
-							Error() << "Invalid property " << current->FunctionPtr->PropertyTableSymbols[data.param].GetName();
-							goto start;
-						}
-						(*ptr)[static_cast<uint16_t>(propertyIdx)] = Registers[byte.target];
-					}
-				} goto start;
+		*var = Registers[byte.target];
+	} DISPATCH();
+
+	TARGET(LoadPropertyCallSymbol)
+	TARGET(LoadProperty) {
+		const Instruction& data = *(Instruction*)current->Ptr++;
+
+		Variable& prop = Registers[byte.in1];
+		auto& cache = current->FunctionPtr->PropertyTable[data.param];
+		uint16_t propertyIdx;
+		if (!cache.Find(prop.getType(), propertyIdx)) {
+			auto& name = current->FunctionPtr->PropertyTableSymbols[data.param];
+			if (!GetManager().GetPropertyIndex(propertyIdx, name, prop.getType())) {
+				Error() << "Property not found: " << name.GetName();
+				Registers[byte.target].setUndefined();
+				DISPATCH();
+			}
+			cache.Add(prop.getType(), propertyIdx);
+		}
 
-				TARGET(Return) {
-					Variable val;
-					if (byte.in1 == 1) {
-						val = Registers[byte.target];
-					}
-					Registers.destroy(current->FunctionPtr->RegisterCount);
-					if (CallStack.size() > 1) {
-						CallStack.pop_back();
-						current = &CallStack.back();
-						Registers.to(current->StackOffset);
-						const Instruction& oldByte = *(Instruction*)(current->Ptr - 2);
-						Registers[oldByte.target] = val;
-					}
-					else {
-						Owner->ReturnPromiseValues[current->PromiseIndex].set_value(val);
-						CallStack.pop_back();
-						Registers.to(0);
-						current = nullptr;
-						interrupt = false;
-						hasReturn = true;
-						goto end;
-					}
-				} goto start;
-
-				TARGET(CallFunction) {
-					const Instruction& data = *(Instruction*)current->Ptr++;
-
-					auto& fn = current->FunctionPtr->FunctionTable[data.data];
-					auto& name = current->FunctionPtr->FunctionTableSymbols[data.data];
-					if (fn == nullptr || fn->Next) {
-						auto res = Owner->GlobalSymbols.FindName(name);
-						if (res.first && res.second->Type == SymbolType::Function) {
-							auto f = res.second->Function;
-							fn = f->GetFirstFitting(byte.in2);
-							if (!fn) {
-								Warn() << "No mathing overloaded function found: " << name;
-								goto start;
-							}
-						}
-						else {
-							Warn() << "Function does not exist: " << name;
-							goto start;
-						}
-					}
+		if (prop.getType() > VariableType::Object) {
+			UserObject* ptr = prop.as<UserObject>();
+			if (ptr->size() <= propertyIdx) {
+				Error() << "Invalid property " << current->FunctionPtr->PropertyTableSymbols[data.param].GetName();
+				Registers[byte.target].setUndefined();
+				DISPATCH();
+			}
+			Registers[byte.target] = (*ptr)[propertyIdx];
+		}
+		if (byte.code == OpCodes::LoadPropertyCallSymbol) {
+			FUSED_TAIL(byte);
+			goto CallSymbol;
+		}
+	} DISPATCH();
+
+	TARGET(StoreProperty) {
+		const Instruction& data = *(Instruction*)current->Ptr++;
+
+		Variable& prop = Registers[byte.in1];
+		auto& cache = current->FunctionPtr->PropertyTable[data.param];
+		uint16_t propertyIdx;
+		if (!cache.Find(prop.getType(), propertyIdx)) {
+			auto& name = current->FunctionPtr->PropertyTableSymbols[data.param];
+			if (!GetManager().GetPropertyIndex(propertyIdx, name, prop.getType())) {
+				Error() << "Property not found: " << name.GetName();
+				DISPATCH();
+			}
+			cache.Add(prop.getType(), propertyIdx);
+		}
 
-					if (!fn->IsPublic && name.GetTarget().IsChildOf(current->FunctionPtr->Name.Get(1))) {
-						Warn() << "Cannot call private function " << name;
-						goto start;
-					}
+		if (prop.getType() > VariableType::Object) {
+			UserObject* ptr = prop.as<UserObject>();
+			if (ptr->size() <= propertyIdx) {
+				Error() << "Invalid property " << current->FunctionPtr->PropertyTableSymbols[data.param].GetName();
+				DISPATCH();
+			}
+			(*ptr)[propertyIdx] = Registers[byte.target];
+		}
+	} DISPATCH();
 
-					switch (fn->Type)
-					{
-					case FunctionType::None: goto start;
-					case FunctionType::User: {
-
-						ScriptFunction* userfn = fn->Local;
-
-						for (size_t i = 0; i < fn->Signature.Arguments.size() && i < byte.in2; i++) {
-							if (fn->Signature.Arguments[i] != VariableType::Undefined
-								&& Registers[byte.in1 + i].getType() != VariableType::Undefined) { // @todo: Once conversions exist remove this
-								VariableType real = fn->Signature.Arguments[i];
-
-								if (real >= VariableType::Object) {
-									size_t typeidx = static_cast<uint16_t>(real) - static_cast<uint16_t>(VariableType::Object);
-									if (typeidx < userfn->TypeTable.size()) {
-										real = userfn->TypeTable[typeidx];
-										if (real == VariableType::Undefined) {
-											auto& type_name = userfn->TypeTableSymbols[typeidx];
-											UserDefinedType* usertype = nullptr;
-											auto res = Owner->GlobalSymbols.FindName(type_name);
-											if (res.second && res.second->Type == SymbolType::Object) {
-												usertype = res.second->UserObject;
-												userfn->TypeTable[typeidx] = real = usertype->Type;
-											}
-										}
-									}
-									else {
-										Error() << "Invalid type while calling " << name;
-									}
-								}
+	TARGET(Return) {
+		Variable val;
+		if (byte.in1 == 1) {
+			val = std::move(Registers[byte.target]);
+		}
+		Registers.destroy(current->FunctionPtr->RegisterCount);
+		if (CallStack.size() > 1) {
+			CallStack.pop();
+			current = &CallStack.back();
+			Registers.to(current->Base, current->Segment);
+			const Instruction& oldByte = *(Instruction*)(current->Ptr - 2);
+			Registers[oldByte.target] = std::move(val);
+		}
+		else {
+			SetResult(current->ResultHandle, std::move(val));
+			CallStack.pop();
+			return;
+		}
+	} SAFEPOINT(1); DISPATCH();
+
+	TARGET(TailCallFunction)
+	TARGET(CallFunction) {
+		const Instruction& data = *(Instruction*)current->Ptr++;
+
+		auto& fn = current->FunctionPtr->FunctionTable[data.data];
+		auto& name = current->FunctionPtr->FunctionTableSymbols[data.data];
+		if (fn == nullptr || fn->Next) {
+			auto res = Owner->GlobalSymbols.FindName(name);
+			if (res.first && res.second->Type == SymbolType::Function) {
+				auto f = res.second->Function;
+				fn = f->GetFirstFitting(byte.in2);
+				if (!fn) {
+					Warn() << "No mathing overloaded function found: " << name;
+					DISPATCH();
+				}
+			}
+			else {
+				Warn() << "Function does not exist: " << name;
+				DISPATCH();
+			}
+		}
+
+		if (!fn->IsPublic && name.GetTarget().IsChildOf(current->FunctionPtr->Name.Get(1))) {
+			Warn() << "Cannot call private function " << name;
+			DISPATCH();
+		}
 
-								if (real != Registers[byte.in1 + i].getType()) {
-									Warn() << "Invalid argument types when calling " << name;
-									goto start;
+		switch (fn->Type)
+		{
+		case FunctionType::None: DISPATCH();
+		case FunctionType::User: {
+
+			ScriptFunction* userfn = fn->Local;
+
+			for (size_t i = 0; i < fn->Signature.Arguments.size() && i < byte.in2; i++) {
+				if (fn->Signature.Arguments[i] != VariableType::Undefined
+					&& Registers[byte.in1 + i].getType() != VariableType::Undefined) { // @todo: Once conversions exist remove this
+					VariableType real = fn->Signature.Arguments[i];
+
+					if (real >= VariableType::Object) {
+						size_t typeidx = static_cast<uint16_t>(real) - static_cast<uint16_t>(VariableType::Object);
+						if (typeidx < userfn->TypeTable.size()) {
+							real = userfn->TypeTable[typeidx];
+							if (real == VariableType::Undefined) {
+								auto& type_name = userfn->TypeTableSymbols[typeidx];
+								UserDefinedType* usertype = nullptr;
+								auto res = Owner->GlobalSymbols.FindName(type_name);
+								if (res.second && res.second->Type == SymbolType::Object) {
+									usertype = res.second->UserObject;
+									userfn->TypeTable[typeidx] = real = usertype->Type;
 								}
 							}
 						}
-
-						auto offset = current->StackOffset + byte.in1;
-						auto& call = CallStack.emplace_back(userfn); // @todo: do this better, too slow
-						call.StackOffset = offset;
-						call.CallingInstruction = current->Ptr - current->FunctionPtr->Bytecode.data();
-						Registers.reserve(call.StackOffset + userfn->RegisterCount);
-						Registers.to(call.StackOffset);
-						current = &call;
-
-						break;
-					}
-					case FunctionType::Host: {
-						thread_local static std::vector<InternalValue> args;
-						args.resize(byte.in2);
-						for (int i = 0; i < byte.in2; ++i) {
-							args[i] = makeHostArg(Registers[byte.in1 + i]);
+						else {
+							Error() << "Invalid type while calling " << name;
 						}
-						InternalValue ret = (*fn->Host)(byte.in2, args.data());
-						Registers[byte.target] = CopyToVM(ret);
-						break;
 					}
-					case FunctionType::Intrinsic: {
-						fn->Intrinsic(Registers[byte.target], &Registers[byte.in1], byte.in2);
-						break;
-					}
-					}
-				} goto start;
 
-				TARGET(CallSymbol) {
-					const Instruction& data = *(Instruction*)current->Ptr++;
-
-					if (Registers[data.target].getType() != VariableType::Function) {
-						Warn() << "Variable does not contain a function";
-						goto start;
+					if (real != Registers[byte.in1 + i].getType()) {
+						Warn() << "Invalid argument types when calling " << name;
+						DISPATCH();
 					}
+				}
+			}
 
-					//@todo: This needs to be optimized, no way to cache direct calls yet
-					FunctionObject* f = Registers[data.target].as<FunctionObject>();
-
-					FunctionSymbol* fnsym = f->Table->GetFirstFitting(byte.in2);
-
-					if (!fnsym) {
-						Warn() << "Argument count does not match";
-						goto start;
-					}
+			if (byte.code == OpCodes::TailCallFunction) {
+				Reenter(current, userfn, byte.in1, byte.in2);
+				break;
+			}
 
-					switch (fnsym->Type)
-					{
-					case FunctionType::User: {
-						auto ptr = fnsym->Local;
-						if (!ptr->IsPublic && ptr->Name.IsChildOf(current->FunctionPtr->Name.Get(1))) {
-							Warn() << "Cannot call private function " << ptr->Name;
-							goto start;
-						}
+			auto& call = CallStack.push(userfn);
+			call.CallingInstruction = current->Ptr - current->FunctionPtr->Bytecode.data();
+			call.Base = Registers.open(&Registers[byte.in1], userfn->RegisterCount, byte.in2);
+			call.Segment = Registers.current();
+			current = &call;
 
+			break;
+		}
+		case FunctionType::Host: {
+			InternalValue ret = CallHost(fn->Host, &Registers[byte.in1], byte.in2);
+			Registers[byte.target] = CopyToVM(ret);
+			break;
+		}
+		case FunctionType::Intrinsic: {
+			fn->Intrinsic(Registers[byte.target], &Registers[byte.in1], byte.in2);
+			break;
+		}
+		}
+	} SAFEPOINT(1); DISPATCH();
 
-						for (size_t i = 0; i < fnsym->Signature.Arguments.size() && i < byte.in2; i++) {
-							if (fnsym->Signature.Arguments[i] != VariableType::Undefined
-								&& Registers[byte.in1 + i].getType() != VariableType::Undefined) { // @todo: Once conversions exist remove this
-								VariableType real = fnsym->Signature.Arguments[i];
-
-								// @todo: is there a way to avoid type checks every call
-								if (real >= VariableType::Object) {
-									size_t typeidx = static_cast<uint16_t>(real) - static_cast<uint16_t>(VariableType::Object);
-									if (typeidx < ptr->TypeTable.size()) {
-										real = ptr->TypeTable[typeidx];
-										if (real == VariableType::Undefined) {
-											auto& name = ptr->TypeTableSymbols[typeidx];
-											auto res = Owner->GlobalSymbols.FindName(name);
-											if (res.second && res.second->Type == SymbolType::Object) {
-												UserDefinedType* usertype = res.second->UserObject;
-												ptr->TypeTable[typeidx] = real = usertype->Type;
-											}
-										}
-									}
-									else {
-										Error() << "Invalid type while calling " << ptr->Name;
-									}
-								}
+	TARGET(TailCallSymbol)
+	TARGET(CallSymbol) {
+		const Instruction& data = *(Instruction*)current->Ptr++;
 
-								if (real != Registers[byte.in1 + i].getType()) {
-									Warn() << "Invalid argument types when calling " << ptr->Name;
-									goto start;
-								}
-							}
-						}
+		if (Registers[data.target].getType() != VariableType::Function) {
+			Warn() << "Variable does not contain a function";
+			DISPATCH();
+		}
 
-						auto offset = current->StackOffset + byte.in1;
-						auto& call = CallStack.emplace_back(ptr); // @todo: do this better, too slow
-						call.StackOffset = offset;
-						call.CallingInstruction = current->Ptr - current->FunctionPtr->Bytecode.data();
-						Registers.reserve(call.StackOffset + ptr->RegisterCount);
-						Registers.to(call.StackOffset);
-						current = &call;
-					} break;
-
-					case FunctionType::Host: {
-						auto ptr = fnsym->Host;
-						thread_local static std::vector<InternalValue> args;
-						args.resize(byte.in2);
-						for (int i = 0; i < byte.in2; ++i) {
-							args[i] = makeHostArg(Registers[byte.in1 + i]);
-						}
-						InternalValue ret = (*ptr)(byte.in2, args.data());
-						Registers[byte.target] = CopyToVM(ret);
-					} break;
-
-					case FunctionType::Intrinsic: {
-						auto ptr = fnsym->Intrinsic;
-						ptr(Registers[byte.target], &Registers[byte.in1], byte.in2);
-					} break;
-
-					case FunctionType::None: {
-						goto start;
-					} break;
-
-					default: 
-					#ifdef _MSC_VER
-					__assume(0);
-					#endif
-					break;
-					}
-				} goto start;
-
-				TARGET(PushUndefined) {
-					Registers[byte.target].setUndefined();
-				} goto start;
-				TARGET(PushBoolean) {
-					Registers[byte.target] = byte.in1 == 1 ? true : false;
-				} goto start;
-				TARGET(PushTypeDefault) {
-					Registers[byte.target] = GetTypeDefault((VariableType)byte.param);
-				} goto start;
-				TARGET(PushArray) {
-					Registers[byte.target] = Array::GetAllocator()->Make(byte.param);
-				} goto start;
-				TARGET(PushObjectDefault) {
-					auto& type = current->FunctionPtr->TypeTable[byte.param];
-					if (type == VariableType::Undefined) {
-						auto& name = current->FunctionPtr->TypeTableSymbols[byte.param];
-						auto res = Owner->GlobalSymbols.FindName(name);
-						if (res.second && res.second->Type == SymbolType::Object) {
-							UserDefinedType* usertype = res.second->UserObject;
-							type = usertype->Type;
-						}
-						else {
-							Error() << "Type not defined: " << name;
-							goto start;
-						}
-					}
+		FunctionObject* f = Registers[data.target].as<FunctionObject>();
+		auto& cache = current->FunctionPtr->CallTable[data.param];
+		FunctionSymbol* fnsym = nullptr;
+		bool untyped = false;
 
-					Registers[byte.target] = GetManager().Make(type);
-				} goto start;
+		if (!cache.Find(f->Table, fnsym, untyped) || fnsym->Next) {
+			fnsym = f->Table->GetFirstFitting(byte.in2);
 
-				TARGET(InitObject) {
-					const Instruction& data = *(Instruction*)current->Ptr++;
+			if (!fnsym) {
+				Warn() << "Argument count does not match";
+				DISPATCH();
+			}
 
-					auto& type = current->FunctionPtr->TypeTable[data.param];
-					if (type == VariableType::Undefined) {
-						auto& name = current->FunctionPtr->TypeTableSymbols[data.param];
-						auto res = Owner->GlobalSymbols.FindName(name);
-						if (res.second && res.second->Type == SymbolType::Object) {
-							UserDefinedType* usertype = res.second->UserObject;
-							type = usertype->Type;
-						}
-						else {
-							Error() << "Type not defined: " << name;
-							goto start;
-						}
-					}
-					auto obj = GetManager().Make(type);
+			untyped = true;
+			if (fnsym->Type == FunctionType::User) {
+				auto ptr = fnsym->Local;
+				if (!ptr->IsPublic && ptr->Name.IsChildOf(current->FunctionPtr->Name.Get(1))) {
+					Warn() << "Cannot call private function " << ptr->Name;
+					DISPATCH();
+				}
+				for (auto type : fnsym->Signature.Arguments) {
+					if (type != VariableType::Undefined) untyped = false;
+				}
+			}
 
-					for (uint16_t i = 0; i < byte.in2 && i < obj.as<UserObject>()->size(); ++i) {
-						(*obj.as<UserObject>())[i] = Registers[byte.in1 + i];
-					}
+			cache.Store(f->Table, fnsym, untyped);
+		}
 
-					Registers[byte.target] = obj;
-
-				} goto start;
-
-				TARGET(Copy) {
-					Registers[byte.target] = Registers[byte.in1];
-				} goto start;
-				TARGET(PushIndex) {
-					Registers[byte.target].as<Array>()->data().push_back(Registers[byte.in1]);
-				} goto start;
-				
-				TARGET(StoreIndex) {
-					if (Registers[byte.in1].getType() == VariableType::Array) {
-						auto& arr = Registers[byte.in1].as<Array>()->data();
-						size_t idx = static_cast<size_t>(toNumber(Registers[byte.in2]));
-						if (arr.size() <= idx) {
-							Error() << "Array out of bounds: Size " << arr.size() << ", tried to access index " << idx;
-							goto start;
-						}
-						arr[idx] = Registers[byte.target];
-					}
-					else {
-						Warn() << "Indexing target is not array";
-					}
-				} goto start;
-
-				TARGET(LoadIndex) {
-					if (Registers[byte.in1].getType() == VariableType::Array) {
-						size_t idx = static_cast<size_t>(toNumber(Registers[byte.in2]));
-						Array* arr = Registers[byte.in1].as<Array>();
-						if (idx < arr->size()) {
-							Registers[byte.target] = arr->data()[idx];
+		switch (fnsym->Type)
+		{
+		case FunctionType::User: {
+			auto ptr = fnsym->Local;
+
+			for (size_t i = 0; !untyped && i < fnsym->Signature.Arguments.size() && i < byte.in2; i++) {
+				if (fnsym->Signature.Arguments[i] != VariableType::Undefined
+					&& Registers[byte.in1 + i].getType() != VariableType::Undefined) { // @todo: Once conversions exist remove this
+					VariableType real = fnsym->Signature.Arguments[i];
+
+					// @todo: is there a way to avoid type checks every call
+					if (real >= VariableType::Object) {
+						size_t typeidx = static_cast<uint16_t>(real) - static_cast<uint16_t>(VariableType::Object);
+						if (typeidx < ptr->TypeTable.size()) {
+							real = ptr->TypeTable[typeidx];
+							if (real == VariableType::Undefined) {
+								auto& name = ptr->TypeTableSymbols[typeidx];
+								auto res = Owner->GlobalSymbols.FindName(name);
+								if (res.second && res.second->Type == SymbolType::Object) {
+									UserDefinedType* usertype = res.second->UserObject;
+									ptr->TypeTable[typeidx] = real = usertype->Type;
+								}
+							}
 						}
 						else {
-							Error() << "Array out of bounds: Size " << arr->size() << ", tried to access index " << idx;
-							goto start;
+							Error() << "Invalid type while calling " << ptr->Name;
 						}
 					}
-					else {
-						Warn() << "Indexing target is not array";
-					}
-				} goto start;
 
-				TARGET(PreMod) {
-					if (byte.in2 == 0) {
-						Registers[byte.target] = Registers[byte.target].as<double>() + 1.0;
-					}
-					else {
-						Registers[byte.target] = Registers[byte.target].as<double>() - 1.0;
+					if (real != Registers[byte.in1 + i].getType()) {
+						Warn() << "Invalid argument types when calling " << ptr->Name;
+						DISPATCH();
 					}
-				} goto start;
-				
-				TARGET(PostMod) {
-					if (byte.in2 == 0) {
-						Registers[byte.target] = Registers[byte.in1];
-						Registers[byte.in1] = Registers[byte.in1].as<double>() + 1.0;
-					}
-					else {
-						Registers[byte.target] = Registers[byte.in1];
-						Registers[byte.in1] = Registers[byte.in1].as<double>() - 1.0;
-					}
-				} goto start;
+				}
+			}
 
-				TARGET(NumAdd) {
-					Registers[byte.target] = Registers[byte.in1].as<double>() + toNumber(Registers[byte.in2]);
-				} goto start;
+			if (byte.code == OpCodes::TailCallSymbol) {
+				Reenter(current, ptr, byte.in1, byte.in2);
+				break;
+			}
 
-				TARGET(StrAdd) {
-					stradd(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
-				} goto start;
+			auto& call = CallStack.push(ptr);
+			call.CallingInstruction = current->Ptr - current->FunctionPtr->Bytecode.data();
+			call.Base = Registers.open(&Registers[byte.in1], ptr->RegisterCount, byte.in2);
+			call.Segment = Registers.current();
+			current = &call;
+		} break;
+
+		case FunctionType::Host: {
+			InternalValue ret = CallHost(fnsym->Host, &Registers[byte.in1], byte.in2);
+			Registers[byte.target] = CopyToVM(ret);
+		} break;
+
+		case FunctionType::Intrinsic: {
+			auto ptr = fnsym->Intrinsic;
+			ptr(Registers[byte.target], &Registers[byte.in1], byte.in2);
+		} break;
+
+		case FunctionType::None: {
+			DISPATCH();
+		} break;
+
+		default: 
+		#ifdef _MSC_VER
+		__assume(0);
+		#endif
+		break;
+		}
+	} SAFEPOINT(1); DISPATCH();
+
+	TARGET(PushUndefined) {
+		Registers[byte.target].setUndefined();
+	} DISPATCH();
+	TARGET(PushBoolean) {
+		Registers[byte.target] = byte.in1 == 1 ? true : false;
+	} DISPATCH();
+	TARGET(PushTypeDefault) {
+		Registers[byte.target] = GetTypeDefault((VariableType)byte.param);
+	} DISPATCH();
+	TARGET(PushArray) {
+		Registers[byte.target] = Array::GetAllocator()->Make(byte.param);
+	} DISPATCH();
+	TARGET(PushObjectDefault) {
+		auto& type = current->FunctionPtr->TypeTable[byte.param];
+		if (type == VariableType::Undefined) {
+			auto& name = current->FunctionPtr->TypeTableSymbols[byte.param];
+			auto res = Owner->GlobalSymbols.FindName(name);
+			if (res.second && res.second->Type == SymbolType::Object) {
+				UserDefinedType* usertype = res.second->UserObject;
+				type = usertype->Type;
+			}
+			else {
+				Error() << "Type not defined: " << name;
+				DISPATCH();
+			}
+		}
 
-				TARGET(NumSub) {
-					Registers[byte.target] = Registers[byte.in1].as<double>() - toNumber(Registers[byte.in2]);
-				} goto start;
+		Registers[byte.target] = GetManager().Make(type);
+	} DISPATCH();
 
-				TARGET(NumDiv) {
-					auto val = Registers[byte.in1].as<double>() / toNumber(Registers[byte.in2]);
-					if (!isnan(val)) {
-						Registers[byte.target] = val;
-					}
-					else {
-						Registers[byte.target].setUndefined();
-					}
-				} goto start;
-
-				TARGET(NumMul) {
-					Registers[byte.target] = Registers[byte.in1].as<double>() * toNumber(Registers[byte.in2]);
-				} goto start;
-
-				// @todo: these could be optimized if the arguments are always the same type
-				TARGET(Add) {
-					 add(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
-				} goto start;
-
-				TARGET(Sub) {
-					sub(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
-				} goto start;
-
-				TARGET(Div) {
-					div(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
-				} goto start;
-
-				TARGET(Mul) {
-					mul(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
-				} goto start;
-				
-				TARGET(Equal) {
-					auto& lhs = Registers[byte.in1];
-					auto& rhs = Registers[byte.in2];
-					if (lhs.getType() != rhs.getType()) { Registers[byte.target] = false; goto start; }
-					switch (lhs.getType())
-					{
-					case VariableType::String: Registers[byte.target] = strcmp(lhs.as<String>()->data(), rhs.as<String>()->data()) == 0; goto start;
-					case VariableType::Number: Registers[byte.target] = fabs(lhs.as<double>() - rhs.as<double>()) < 0.00001; goto start;
-					case VariableType::Boolean: Registers[byte.target] = lhs.as<bool>() == rhs.as<bool>(); goto start;
-					case VariableType::Undefined: Registers[byte.target] = false; goto start;
-					default:
-						Registers[byte.target] = lhs.operator==(rhs);
-						goto start;
-					}
-				} goto start;
-
-				TARGET(NotEqual) {
-					auto& lhs = Registers[byte.in1];
-					auto& rhs = Registers[byte.in2];
-					if (lhs.getType() != rhs.getType()) { Registers[byte.target] = true; goto start; }
-					switch (lhs.getType())
-					{
-					case VariableType::String: Registers[byte.target] = strcmp(lhs.as<String>()->data(), rhs.as<String>()->data()) != 0; goto start;
-					case VariableType::Number: Registers[byte.target] = fabs(lhs.as<double>() - rhs.as<double>()) > 0.00001; goto start;
-					case VariableType::Boolean: Registers[byte.target] = lhs.as<bool>() != rhs.as<bool>(); goto start;
-					case VariableType::Undefined: Registers[byte.target] = false; goto start;
-					default:
-						Registers[byte.target] = !lhs.operator==(rhs);
-						goto start;
-					}
-				} goto start;
-
-				TARGET(Not) {
-					Registers[byte.target] = !isTruthy(Registers[byte.in1]); // @todo: fix this
-				} goto start;
-				
-				TARGET(And) {
-					Registers[byte.target] = isTruthy(Registers[byte.in1]) && isTruthy(Registers[byte.in2]);
-				} goto start;
-				
-				TARGET(Or) {
-					Registers[byte.target] = isTruthy(Registers[byte.in1]) || isTruthy(Registers[byte.in2]);
-				} goto start;
-
-				TARGET(JumpEq) {
-					if (isTruthy(Registers[byte.target])) {
-						current->Ptr += byte.param;
-					}
-				} goto start;
-
-				TARGET(JumpNeg) {
-					if (!isTruthy(Registers[byte.target])) {
-						current->Ptr += byte.param;
-					}
-				} goto start;
+	TARGET(InitObject) {
+		const Instruction& data = *(Instruction*)current->Ptr++;
 
-				TARGET(Less) {
-					Registers[byte.target] = toNumber(Registers[byte.in1]) < toNumber(Registers[byte.in2]);
-				} goto start;
+		auto& type = current->FunctionPtr->TypeTable[data.param];
+		if (type == VariableType::Undefined) {
+			auto& name = current->FunctionPtr->TypeTableSymbols[data.param];
+			auto res = Owner->GlobalSymbols.FindName(name);
+			if (res.second && res.second->Type == SymbolType::Object) {
+				UserDefinedType* usertype = res.second->UserObject;
+				type = usertype->Type;
+			}
+			else {
+				Error() << "Type not defined: " << name;
+				DISPATCH();
+			}
+		}
+		auto obj = GetManager().Make(type);
 
-				TARGET(LessEqual) {
-					Registers[byte.target] = toNumber(Registers[byte.in1]) <= toNumber(Registers[byte.in2]);
-				} goto start;
+		for (uint16_t i = 0; i < byte.in2 && i < obj.as<UserObject>()->size(); ++i) {
+			(*obj.as<UserObject>())[i] = Registers[byte.in1 + i];
+		}
 
-				TARGET(Greater) {
-					Registers[byte.target] = toNumber(Registers[byte.in1]) > toNumber(Registers[byte.in2]);
-				} goto start;
+		Registers[byte.target] = obj;
+
+	} DISPATCH();
+
+	TARGET(Copy) {
+		Registers[byte.target] = Registers[byte.in1];
+	} DISPATCH();
+
+	TARGET(CopyCallFunction) {
+		Registers[byte.target] = Registers[byte.in1];
+		FUSED_TAIL(byte);
+	} goto CallFunction;
+	TARGET(PushIndex) {
+		Registers[byte.target].as<Array>()->push(Registers[byte.in1]);
+	} DISPATCH();
+	
+	TARGET(StoreIndex) {
+		if (Registers[byte.in1].getType() == VariableType::Array) {
+			Array* arr = Registers[byte.in1].as<Array>();
+			size_t idx = toIndex(Registers[byte.in2]);
+			if (arr->size() <= idx) {
+				Error() << "Array out of bounds: Size " << arr->size() << ", tried to access index " << idx;
+				DISPATCH();
+			}
+			arr->set(idx, Registers[byte.target]);
+		}
+		else {
+			Warn() << "Indexing target is not array";
+		}
+	} DISPATCH();
+
+	TARGET(LoadIndex) {
+		if (Registers[byte.in1].getType() == VariableType::Array) {
+			size_t idx = toIndex(Registers[byte.in2]);
+			Array* arr = Registers[byte.in1].as<Array>();
+			if (idx < arr->size()) {
+				Registers[byte.target] = arr->get(idx);
+			}
+			else {
+				Error() << "Array out of bounds: Size " << arr->size() << ", tried to access index " << idx;
+				DISPATCH();
+			}
+		}
+		else {
+			Warn() << "Indexing target is not array";
+		}
+	} DISPATCH();
 
-				TARGET(GreaterEqual) {
-					Registers[byte.target] = toNumber(Registers[byte.in1]) >= toNumber(Registers[byte.in2]);
-				} goto start;
+	TARGET(PreMod) {
+		auto& var = Registers[byte.target];
+		if (var.isInt() && var.asInt() != (byte.in2 == 0 ? INT32_MAX : INT32_MIN)) {
+			var = var.asInt() + (byte.in2 == 0 ? 1 : -1);
+		}
+		else {
+			var = var.as<double>() + (byte.in2 == 0 ? 1.0 : -1.0);
+		}
+	} DISPATCH();
+	
+	TARGET(PostMod) {
+		auto& var = Registers[byte.in1];
+		Registers[byte.target] = var;
+		if (var.isInt() && var.asInt() != (byte.in2 == 0 ? INT32_MAX : INT32_MIN)) {
+			var = var.asInt() + (byte.in2 == 0 ? 1 : -1);
+		}
+		else {
+			var = var.as<double>() + (byte.in2 == 0 ? 1.0 : -1.0);
+		}
+	} DISPATCH();
+
+	TARGET(LoadNumberNumAdd) {
+		Registers[byte.target] = NUMS[byte.param];
+		Instruction op;
+		FUSED_TAIL(op);
+		numadd(Registers[op.target], Registers[op.in1], Registers[byte.target]);
+	} DISPATCH();
+
+	TARGET(LoadNumberNumSub) {
+		Registers[byte.target] = NUMS[byte.param];
+		Instruction op;
+		FUSED_TAIL(op);
+		numsub(Registers[op.target], Registers[op.in1], Registers[byte.target]);
+	} DISPATCH();
+
+	TARGET(LoadImmediateNumAdd) {
+		Registers[byte.target] = (int16_t)byte.param;
+		Instruction op;
+		FUSED_TAIL(op);
+		numadd(Registers[op.target], Registers[op.in1], Registers[byte.target]);
+	} DISPATCH();
+
+	TARGET(LoadImmediateNumSub) {
+		Registers[byte.target] = (int16_t)byte.param;
+		Instruction op;
+		FUSED_TAIL(op);
+		numsub(Registers[op.target], Registers[op.in1], Registers[byte.target]);
+	} DISPATCH();
+
+	TARGET(NumAdd) {
+		auto& rhs = Registers[byte.in2];
+		if (rhs.isNumber()) numadd(Registers[byte.target], Registers[byte.in1], rhs);
+		else Registers[byte.target] = Registers[byte.in1].as<double>() + toNumber(rhs);
+	} DISPATCH();
+
+	TARGET(StrAdd) {
+		stradd(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
+	} DISPATCH();
+
+	TARGET(NumSub) {
+		auto& rhs = Registers[byte.in2];
+		if (rhs.isNumber()) numsub(Registers[byte.target], Registers[byte.in1], rhs);
+		else Registers[byte.target] = Registers[byte.in1].as<double>() - toNumber(rhs);
+	} DISPATCH();
+
+	TARGET(NumDiv) {
+		auto val = Registers[byte.in1].as<double>() / toNumber(Registers[byte.in2]);
+		if (!isnan(val)) {
+			Registers[byte.target] = val;
+		}
+		else {
+			Registers[byte.target].setUndefined();
+		}
+	} DISPATCH();
+
+	TARGET(NumMul) {
+		auto& rhs = Registers[byte.in2];
+		if (rhs.isNumber()) nummul(Registers[byte.target], Registers[byte.in1], rhs);
+		else Registers[byte.target] = Registers[byte.in1].as<double>() * toNumber(rhs);
+	} DISPATCH();
+
+	// Generic operations rewrite themselves to the number variant when both operands are numbers,
+	// the number variants rewrite back when the guard fails. The word is only replaced if it still holds
+	// the executing instruction, so breakpoints and concurrent rewrites are never overwritten.
+#define QUICKEN(op) do { \
+	Instruction quick = byte; \
+	quick.code = OpCodes::op; \
+	ReplaceCodeWord(const_cast<uint32_t*>(current->Ptr - 1), byte.data, quick.data); \
+} while (0)
+#define QUICK_GUARD(generic) \
+	auto& lhs = Registers[byte.in1]; \
+	auto& rhs = Registers[byte.in2]; \
+	if (!lhs.isNumber() || !rhs.isNumber()) [[unlikely]] { \
+		QUICKEN(generic); \
+		byte.code = OpCodes::generic; \
+		goto generic; \
+	}
 
+	TARGET(Add) {
+		if (Registers[byte.in1].isNumber() && Registers[byte.in2].isNumber()) QUICKEN(AddNumber);
+		add(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
+	} DISPATCH();
+
+	TARGET(Sub) {
+		if (Registers[byte.in1].isNumber() && Registers[byte.in2].isNumber()) QUICKEN(SubNumber);
+		sub(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
+	} DISPATCH();
+
+	TARGET(Div) {
+		if (Registers[byte.in1].isNumber() && Registers[byte.in2].isNumber()) QUICKEN(DivNumber);
+		div(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
+	} DISPATCH();
+
+	TARGET(Mul) {
+		if (Registers[byte.in1].isNumber() && Registers[byte.in2].isNumber()) QUICKEN(MulNumber);
+		mul(Registers[byte.target], Registers[byte.in1], Registers[byte.in2]);
+	} DISPATCH();
+
+	TARGET(AddNumber) {
+		QUICK_GUARD(Add)
+		numadd(Registers[byte.target], lhs, rhs);
+	} DISPATCH();
+
+	TARGET(SubNumber) {
+		QUICK_GUARD(Sub)
+		numsub(Registers[byte.target], lhs, rhs);
+	} DISPATCH();
+
+	TARGET(DivNumber) {
+		QUICK_GUARD(Div)
+		auto val = lhs.as<double>() / rhs.as<double>();
+		if (!isnan(val)) {
+			Registers[byte.target] = val;
 		}
-	end:
-		if (hasReturn) {
+		else {
+			Registers[byte.target].setUndefined();
+		}
+	} DISPATCH();
+
+	TARGET(MulNumber) {
+		QUICK_GUARD(Mul)
+		nummul(Registers[byte.target], lhs, rhs);
+	} DISPATCH();
+
+	TARGET(LessNumber) {
+		QUICK_GUARD(Less)
+		Registers[byte.target] = NUM_COMPARE(lhs, rhs, <);
+	} DISPATCH();
+
+	TARGET(EqualNumber) {
+		QUICK_GUARD(Equal)
+		Registers[byte.target] = numequal(lhs, rhs);
+	} DISPATCH();
+	
+	TARGET(Equal) {
+		auto& lhs = Registers[byte.in1];
+		auto& rhs = Registers[byte.in2];
+		if (lhs.isNumber() && rhs.isNumber()) QUICKEN(EqualNumber);
+		if (lhs.getType() != rhs.getType()) { Registers[byte.target] = false; DISPATCH(); }
+		switch (lhs.getType())
+		{
+		case VariableType::String: Registers[byte.target] = lhs.as<String>()->Equals(rhs.as<String>()); DISPATCH();
+		case VariableType::Number: Registers[byte.target] = numequal(lhs, rhs); DISPATCH();
+		case VariableType::Boolean: Registers[byte.target] = lhs.as<bool>() == rhs.as<bool>(); DISPATCH();
+		case VariableType::Undefined: Registers[byte.target] = false; DISPATCH();
+		default:
+			Registers[byte.target] = lhs.operator==(rhs);
+			DISPATCH();
+		}
+	} DISPATCH();
 
+	TARGET(NotEqual) {
+		auto& lhs = Registers[byte.in1];
+		auto& rhs = Registers[byte.in2];
+		if (lhs.getType() != rhs.getType()) { Registers[byte.target] = true; DISPATCH(); }
+		switch (lhs.getType())
+		{
+		case VariableType::String: Registers[byte.target] = !lhs.as<String>()->Equals(rhs.as<String>()); DISPATCH();
+		case VariableType::Number: Registers[byte.target] = !numequal(lhs, rhs); DISPATCH();
+		case VariableType::Boolean: Registers[byte.target] = lhs.as<bool>() != rhs.as<bool>(); DISPATCH();
+		case VariableType::Undefined: Registers[byte.target] = false; DISPATCH();
+		default:
+			Registers[byte.target] = !lhs.operator==(rhs);
+			DISPATCH();
 		}
+	} DISPATCH();
+
+	TARGET(Not) {
+		Registers[byte.target] = !isTruthy(Registers[byte.in1]); // @todo: fix this
+	} DISPATCH();
+	
+	TARGET(And) {
+		Registers[byte.target] = isTruthy(Registers[byte.in1]) && isTruthy(Registers[byte.in2]);
+	} DISPATCH();
+	
+	TARGET(Or) {
+		Registers[byte.target] = isTruthy(Registers[byte.in1]) || isTruthy(Registers[byte.in2]);
+	} DISPATCH();
+
+	TARGET(JumpEq) {
+		if (isTruthy(Registers[byte.target])) {
+			current->Ptr += byte.param;
+		}
+	} DISPATCH();
 
-	}
+	TARGET(JumpNeg) {
+		if (!isTruthy(Registers[byte.target])) {
+			current->Ptr += byte.param;
+		}
+	} DISPATCH();
+
+	TARGET(Less) {
+		if (Registers[byte.in1].isNumber() && Registers[byte.in2].isNumber()) QUICKEN(LessNumber);
+		Registers[byte.target] = NUM_COMPARE(Registers[byte.in1], Registers[byte.in2], <);
+	} DISPATCH();
+
+	TARGET(LessEqual) {
+		Registers[byte.target] = NUM_COMPARE(Registers[byte.in1], Registers[byte.in2], <=);
+	} DISPATCH();
+
+	TARGET(Greater) {
+		Registers[byte.target] = NUM_COMPARE(Registers[byte.in1], Registers[byte.in2], >);
+	} DISPATCH();
+
+	TARGET(GreaterEqual) {
+		Registers[byte.target] = NUM_COMPARE(Registers[byte.in1], Registers[byte.in2], >=);
+	} DISPATCH();
+
+#define COMPARE_JUMP(op) { \
+		bool result = NUM_COMPARE(Registers[byte.in1], Registers[byte.in2], op); \
+		Registers[byte.target] = result; \
+		Instruction jump; \
+		FUSED_TAIL(jump); \
+		if (!result) current->Ptr += jump.param; \
+	} DISPATCH();
+
+	TARGET(LessJumpNeg) COMPARE_JUMP(<)
+	TARGET(LessEqualJumpNeg) COMPARE_JUMP(<=)
+	TARGET(GreaterJumpNeg) COMPARE_JUMP(>)
+	TARGET(GreaterEqualJumpNeg) COMPARE_JUMP(>=)
+#undef COMPARE_JUMP
+#undef FUSED_TAIL
+#undef QUICK_GUARD
+#undef QUICKEN
+#undef NUM_COMPARE
+
+#undef SAFEPOINT
+#undef DISPATCH
+#undef NUMS
+#undef STRS
 }
 
-CallObject::CallObject(ScriptFunction* function)
+void CallObject::Init(ScriptFunction* function)
 {
-	PromiseIndex = 0;
+	ResultHandle = 0;
 	FunctionPtr = function;
-	StackOffset = 0;
+	CallingInstruction = 0;
+	Base = nullptr;
+	Segment = 0;
 	Ptr = function->Bytecode.data();
 	End = function->Bytecode.data() + function->Bytecode.size();
 }
@@ -6,6 +6,9 @@
 #include <stack>
 #include <future>
 #include <span>
+#include <atomic>
+#include <memory>
+#include <chrono>
 #include "ankerl/unordered_dense.h"
 
 #include "EMI/EMI.h"
@@ -14,6 +17,8 @@
 #include "Intrinsic.h"
 #include "Namespace.h"
 #include "Objects/UserObject.h"
+#include "WorkQueue.h"
+#include "ResultSlots.h"
 
 #ifdef INCLUDE_DEBUGGER
 #include "DebugInfo.h"
@@ -50,48 +55,183 @@ struct CompileOptions
 	}
 };
 
+// Frame of a call that ran out of its instruction budget
+struct SuspendedFrame
+{
+	ScriptFunction* FunctionPtr;
+	size_t Instruction;
+	size_t CallingInstruction;
+};
+
+// Calls of a VMHandle::CallBatch, shared by the runners working on it
+struct BatchCall
+{
+	static constexpr size_t MaxChunkSize = 64;
+
+	ScriptFunction* FunctionPtr = nullptr;
+	// Rows of ArgumentCount values, owned by the host until the batch is done
+	const InternalValue* Arguments = nullptr;
+	InternalValue* Results = nullptr;
+	size_t ArgumentCount = 0;
+	// Leading values of each row passed to the function, their types were checked for the whole batch
+	size_t PassedCount = 0;
+	size_t Count = 0;
+	size_t ChunkSize = 1;
+	// First call not claimed yet, runners claim a chunk at a time
+	std::atomic<size_t> Next{ 0 };
+	std::atomic<size_t> Remaining{ 0 };
+	// Runners asked to work on the batch
+	std::atomic<size_t> Workers{ 1 };
+	std::atomic<uint32_t> Done{ 0 };
+
+	void Finish(size_t calls) {
+		if (Remaining.fetch_sub(calls, std::memory_order_acq_rel) == calls) {
+			Done.store(1, std::memory_order_release);
+			FutexWake(Done, true);
+		}
+	}
+};
+
+// Call waiting in the VM queue for a free runner
+struct CallRequest
+{
+	ScriptFunction* FunctionPtr = nullptr;
+	std::vector<Variable> Arguments;
+	size_t ResultHandle = 0;
+	// Instructions to run before requeueing, 0 for no limit
+	size_t Budget = 0;
+	// Suspended call state, the registers of each frame are stored one after another in Arguments
+	std::vector<SuspendedFrame> Frames;
+	// Register in Arguments receiving the value of the event a parked call waits for
+	size_t ResumeRegister = 0;
+	// Set for requests working on a batch instead of a single call
+	std::shared_ptr<BatchCall> Batch;
+	// Interrupt epoch of the VM when the call started
+	uint32_t Epoch = 0;
+
+	CallRequest() = default;
+	CallRequest(ScriptFunction* function) : FunctionPtr(function) {}
+};
+
 struct CallObject 
 {
 	ScriptFunction* FunctionPtr;
 	const uint32_t* Ptr;
 	const uint32_t* End;
 	size_t CallingInstruction;
-	size_t StackOffset;
-	size_t PromiseIndex;
-	std::vector<Variable> Arguments;
+	// Register window of the call, and the register segment it lives in
+	Variable* Base;
+	size_t Segment;
+	size_t ResultHandle;
 
-	CallObject(ScriptFunction* function);
+	CallObject() : FunctionPtr(nullptr), Ptr(nullptr), End(nullptr), CallingInstruction(0), Base(nullptr), Segment(0), ResultHandle(0) {}
+	void Init(ScriptFunction* function);
 };
 
+// Call frames stored in fixed size segments, frames never move once pushed.
+// Segments are kept when the stack shrinks so calls do not allocate once the stack has been that deep.
+class FrameStack
+{
+public:
+	CallObject& push(ScriptFunction* function) {
+		if (count == segments.size() * SegmentSize) {
+			segments.emplace_back(std::make_unique<CallObject[]>(SegmentSize));
+		}
+		CallObject& call = segments[count / SegmentSize][count % SegmentSize];
+		call.Init(function);
+		count++;
+		return call;
+	}
+
+	void pop() { count--; }
+
+	CallObject& back() { return (*this)[count - 1]; }
+	const CallObject& back() const { return (*this)[count - 1]; }
+	CallObject& operator[](size_t index) { return segments[index / SegmentSize][index % SegmentSize]; }
+	const CallObject& operator[](size_t index) const { return segments[index / SegmentSize][index % SegmentSize]; }
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+private:
+	static constexpr size_t SegmentSize = 64;
+
+	size_t count = 0;
+	std::vector<std::unique_ptr<CallObject[]>> segments;
+};
+
+// Register windows stored in fixed size segments. Calls open their window on top of the arguments in the
+// caller's window, if it does not fit the window moves to the next segment and the arguments are copied.
 template <typename T>
 class RegisterStack
 {
 public:
-	void to(size_t location) {
-		top = location;
-		fast = &stack[top];
+	// Window for the first call of a runner
+	T* reset() {
+		if (segments.empty()) {
+			segments.emplace_back(std::make_unique<T[]>(SegmentSize));
+		}
+		to(segments[0].get(), 0);
+		return fast;
+	}
+
+	T* open(T* base, size_t count, size_t args) {
+		if (base + count <= end) {
+			fast = base;
+			return fast;
+		}
+
+		segment++;
+		if (segment == segments.size()) {
+			segments.emplace_back(std::make_unique<T[]>(SegmentSize));
+		}
+		T* next = segments[segment].get();
+		for (size_t i = 0; i < args; i++) {
+			next[i] = base[i];
+		}
+		fast = next;
+		end = next + SegmentSize;
+		return fast;
+	}
+
+	void to(T* base, size_t index) {
+		fast = base;
+		segment = index;
+		end = segments[index].get() + SegmentSize;
 	}
 
 	void destroy(size_t count) {
 		for (size_t i = 0; i < count; i++) {
-			fast[i].~T();
+			fast[i] = T();
 		}
 	}
 
-	void reserve(size_t count) {
-		if (count > stack.size()) stack.resize(count);
-		fast = &stack[top];
-	}
+	size_t current() const { return segment; }
 
 	T& operator[](size_t location) {
 		return fast[location];
 	}
 
 private:
+	// Registers are addressed with 8 bits, any window fits in an empty segment
+	static constexpr size_t SegmentSize = 4096;
 
-	size_t top = 0;
-	std::vector<T> stack;
+	size_t segment = 0;
+	std::vector<std::unique_ptr<T[]>> segments;
 	T* fast = nullptr;
+	T* end = nullptr;
+};
+
+// Requests for the runner to leave the interpreter loop, checked at safepoints
+enum class RunnerSignal : uint8_t
+{
+	None = 0,
+	Stop = 1,
+	Debug = 2,
+	Interrupt = 4,
+	Collect = 8,
+	// The call waits in delay, yield or wait and is parked
+	Yield = 16,
 };
 
 #ifdef INCLUDE_DEBUGGER
@@ -107,16 +247,39 @@ enum class SteppingType
 class Runner
 {
 public:
-	Runner(VM* vm);
+	// Pooled runners take calls from the VM queue on their own thread, others only run inline calls
+	Runner(VM* vm, bool pooled = true);
 	~Runner();
 	void Join();
 
-	void SetRunning(bool value) { Running = value; }
-	const std::vector<CallObject>& GetCallStack() const { return CallStack; }
+	// Runs the call to completion on the calling thread
+	Variable CallInline(ScriptFunction* function, const std::vector<VariableType>& argTypes, const std::span<InternalValue>& args);
+	bool IsBusy() const { return Busy; }
+
+	// Runner executing scripts on the calling thread, if any
+	static Runner* Current();
+	// Park the running call once the current instruction has finished, the runner takes other calls meanwhile.
+	// Return false if the call cannot be suspended, synchronous and batched calls run to completion.
+	bool ParkYield();
+	bool ParkTimer(std::chrono::steady_clock::time_point until);
+	// The signaled value is stored in out when the call resumes
+	bool ParkEvent(const std::string& name, Variable& out);
+
+	void SetRunning(bool value) { Running = value; if (!Running) Raise(RunnerSignal::Stop); else Clear(RunnerSignal::Stop); }
+	// Aborts the running call at its next safepoint
+	void Interrupt() { Raise(RunnerSignal::Interrupt); }
+	const FrameStack& GetCallStack() const { return CallStack; }
 	ScriptFunction* GetCurrentFunction() const { return CallStack.empty() ? nullptr : CallStack.back().FunctionPtr; }
 #ifdef INCLUDE_DEBUGGER
 	const uint32_t* GetCurrentPointer() const { return CurrentInstruction; }
-	void SetPaused(bool value) { Paused = value; if (!Paused) Stepping = SteppingType::None; }
+	void SetPaused(bool value) {
+		Paused = value;
+		if (Paused) Raise(RunnerSignal::Debug);
+		else {
+			Stepping = SteppingType::None;
+			Clear(RunnerSignal::Debug);
+		}
+	}
 	void SetTargetInstruction(uint32_t* instruction) { TargetInstruction = instruction; }
 	int GetPauseDepth() const { return PauseDepth; }
 	void SetPauseDepth(int depth) { PauseDepth = depth; }
@@ -130,11 +293,72 @@ private:
 #endif
 private:
 	void Run();
+	template <bool Debug>
+	void Execute();
+	// Replaces the current call with a tail call, the arguments are moved to the start of the window
+	void Reenter(CallObject* current, ScriptFunction* function, uint8_t args, uint8_t count);
+	void Abort();
+	// Moves the call stack and registers to the request
+	void Save(CallRequest* request);
+	void Suspend(CallRequest* request);
+	void Park(CallRequest* request);
+	// Completes the first call of the stack
+	void SetResult(size_t handle, Variable&& value);
+	void Restore(CallRequest& request);
+	// Pushes a call returning to InlineResult
+	void Start(ScriptFunction* function, const std::vector<VariableType>& argTypes, std::span<const InternalValue> args);
+	// Same for arguments already converted and checked, they are moved to the registers
+	void Start(ScriptFunction* function, std::span<Variable> args);
+	// Runs until the call stack is empty, false if the call was aborted
+	bool Finish();
+	void RunBatch(const std::shared_ptr<BatchCall>& batch);
+	// Own deque first, then the shared queue, then the other runners
+	bool FindWork(CallRequest*& request);
+
+	void Raise(RunnerSignal signal) { Signals.fetch_or(static_cast<uint8_t>(signal)); }
+	void Clear(RunnerSignal signal) { Signals.fetch_and(static_cast<uint8_t>(~static_cast<uint8_t>(signal))); }
+	bool HasSignal(RunnerSignal signal) const { return Signals.load(std::memory_order_relaxed) & static_cast<uint8_t>(signal); }
+
+	// Result handle of calls that return to InlineResult, inline and batch calls
+	static constexpr size_t InlineCall = (size_t)-1;
+
 	bool Running;
+	bool Busy;
+	// Only calls run from the queue can be parked
+	bool Suspendable;
+	// Runs calls from the VM queue on its own thread, inline runners are never paused
+	bool Pooled;
+
+	enum class WaitType : uint8_t
+	{
+		None,
+		Yield,
+		Timer,
+		Event,
+	};
+	// Set by the intrinsics, the call is parked when it reaches a safepoint
+	struct
+	{
+		WaitType Type = WaitType::None;
+		std::chrono::steady_clock::time_point Until;
+		std::string Event;
+		uint64_t Epoch = 0;
+		size_t Register = 0;
+	} Waiting;
+	Variable InlineResult;
+	// Arguments of the batch chunk being run, converted together
+	std::vector<Variable> BatchArguments;
+	std::atomic<uint8_t> Signals;
+	// Instructions left before the call is requeued, counted at safepoints
+	int64_t Fuel;
 	VM* Owner;
 	std::thread RunThread;
-	std::vector<CallObject> CallStack;
+	FrameStack CallStack;
 	RegisterStack<Variable> Registers;
+	// Calls taken from the shared queue in a batch, other runners steal from here when idle
+	static constexpr size_t BatchSize = 4;
+	WorkStealingDeque<CallRequest*> Local;
+	size_t Victim;
 };
 
 inline auto& HostFunctions() {
@@ -162,10 +386,23 @@ public:
 
 	void* GetFunctionID(const std::string& name);
 
-	size_t CallFunction(FunctionHandle handle, const std::span<InternalValue>& args);
-	size_t DirectCallFunction(ScriptFunction* symbol, const std::vector<VariableType>& argTypes, const std::span<InternalValue>& args);
+	size_t CallFunction(FunctionHandle handle, const std::span<InternalValue>& args, size_t budget = FunctionHandle::DefaultBudget);
+	size_t DirectCallFunction(ScriptFunction* symbol, const std::vector<VariableType>& argTypes, const std::span<InternalValue>& args, size_t budget);
+	// Hands the call to the runners, blocks while the shared queue is full
+	void Submit(CallRequest* request);
+	// Runs the call on the calling thread with a runner owned by the thread
+	InternalValue CallFunctionInline(FunctionHandle handle, const std::span<InternalValue>& args);
+	// Splits the calls between the runners and waits for all of them
+	bool CallBatch(FunctionHandle handle, size_t argCount, size_t count, const InternalValue* args, InternalValue* results);
+	void SetInstructionBudget(size_t count) { InstructionBudget.store(count, std::memory_order_relaxed); }
+	void SetCollectorPacing(size_t allocations, size_t sliceSize);
 	InternalValue GetReturnValue(size_t index);
+	bool IsReturnReady(size_t index);
+	// The result of the call will not be taken
+	void DiscardReturnValue(size_t index);
 	bool WaitForResult(void* ptr);
+	// Resumes the calls waiting for the event, the value is returned from their wait calls
+	size_t SignalEvent(const char* name, const InternalValue& value);
 
 	std::pair<PathType, Symbol*> FindSymbol(const PathTypeQuery& name);
 	void AddCompileUnit(const std::string& path, const SymbolTable& space, ScriptFunction* InitFunction);
@@ -195,30 +432,68 @@ private:
 	friend class Parser;
 	friend class Runner;
 
-	void GarbageCollect();
 
 	// When adding new compile targets
 	std::mutex CompileMutex;
 	// When merging compile results to VM
 	std::mutex MergeMutex;
-	// When editing call queue
-	std::mutex CallMutex;
 
 	std::list<std::future<bool>> CompileRequests;
 
 	std::condition_variable QueueNotify;
 	std::queue<CompileOptions> CompileQueue;
 	std::vector<std::thread> ParserPool;
-	std::thread* GarbageCollector;
 	bool CompileRunning;
 	bool VMRunning;
 
-	std::condition_variable CallQueueNotify;
-	std::queue<CallObject> CallQueue;
+	static constexpr size_t CallQueueSize = 4096;
+	MPMCQueue<CallRequest*> CallQueue;
+	EventCount WorkNotify;
+	// Runners are added while earlier ones already steal, the pool is reserved up front and the count published after each
 	std::vector<Runner*> RunnerPool;
-	std::vector<std::future<Variable>> ReturnValues;
-	std::vector<std::promise<Variable>> ReturnPromiseValues;
-	std::vector<size_t> ReturnFreeList;
+	std::atomic<size_t> RunnerCount;
+
+	Runner* GetInlineRunner();
+	// Runners for synchronous calls, one for each calling thread
+	std::mutex InlineMutex;
+	ankerl::unordered_dense::map<std::thread::id, Runner*> InlineRunners;
+	// Unique for each VM, an address could be reused by a later VM
+	uint64_t Id;
+	ResultSlots Results;
+	// Default budget for new calls, read by any thread submitting one
+	std::atomic<size_t> InstructionBudget;
+	// Bumped by Interrupt, suspended calls that started before it are dropped when resumed
+	std::atomic<uint32_t> InterruptEpoch;
+
+	// Calls parked in delay, resumed by the timer thread started with the first one
+	struct TimedCall
+	{
+		std::chrono::steady_clock::time_point Until;
+		CallRequest* Request;
+		bool operator>(const TimedCall& other) const { return Until > other.Until; }
+	};
+	void ParkTimer(CallRequest* request, std::chrono::steady_clock::time_point until);
+	void RunTimers();
+	std::mutex TimerMutex;
+	std::condition_variable TimerNotify;
+	std::priority_queue<TimedCall, std::vector<TimedCall>, std::greater<TimedCall>> Timers;
+	std::thread TimerThread;
+	bool TimersRunning;
+
+	// Calls parked in wait. The epoch changes with each signal, a call signaled while it was being parked
+	// is resumed right away.
+	struct EventWaiters
+	{
+		uint64_t Epoch = 0;
+		Variable Value;
+		std::vector<CallRequest*> Calls;
+	};
+	uint64_t GetEventEpoch(const std::string& name);
+	void ParkEvent(CallRequest* request, const std::string& name, uint64_t epoch);
+	std::mutex EventMutex;
+	ankerl::unordered_dense::map<std::string, EventWaiters> Events;
+	// Completes the parked calls with undefined
+	void DropParked();
 
 	ankerl::unordered_dense::map<std::string, CompileUnit> Units;
 	SymbolTable GlobalSymbols;
@@ -3,28 +3,17 @@
 #include "Objects/StringObject.h"
 #include <math.h>
 
-Variable::Variable(const Variable& rhs)
+Variable::Variable(const Variable& rhs) : value(rhs.value)
 {
 	if (isObject()) {
-		as<Object>()->RefCount--;
-	}
-	value = rhs.value;
-
-	if (isObject()) {
-		as<Object>()->RefCount++;
+		as<Object>()->AddRef();
 	}
 }
 
-Variable::Variable(Variable&& rhs) noexcept
+// Moves take over the reference of the source, refcounts are not touched
+Variable::Variable(Variable&& rhs) noexcept : value(rhs.value)
 {
-	if (isObject()) {
-		as<Object>()->RefCount--;
-	}
-	value = rhs.value;
-
-	if (isObject()) {
-		as<Object>()->RefCount++;
-	}
+	rhs.value = NIL_VAL;
 }
 
 Variable::Variable(double v)
@@ -37,14 +26,14 @@ Variable::Variable(Object* ptr)
 	if (ptr == nullptr) value = NIL_VAL;
 	else {
 		value = OBJ_VAL(ptr);
-		as<Object>()->RefCount++;
+		as<Object>()->AddRef();
 	}
 }
 
 Variable::~Variable()
 {
 	if (isObject()) {
-		as<Object>()->RefCount--;
+		as<Object>()->Release();
 	}
 	value = NIL_VAL;
 }
@@ -52,7 +41,7 @@ Variable::~Variable()
 void Variable::setUndefined()
 {
 	if (isObject()) {
-		as<Object>()->RefCount--;
+		as<Object>()->Release();
 	}
 	value = NIL_VAL;
 }
@@ -64,29 +53,26 @@ bool Variable::isString() const
 
 Variable& Variable::operator=(const Variable& rhs)
 {
-	if (isObject()) {
-		as<Object>()->RefCount--;
+	if (rhs.isObject()) {
+		rhs.as<Object>()->AddRef();
 	}
-
-	value = rhs.value;
-
 	if (isObject()) {
-		as<Object>()->RefCount++;
+		as<Object>()->Release();
 	}
+	value = rhs.value;
 
 	return *this;
 }
 
 Variable& Variable::operator=(Variable&& rhs) noexcept
 {
+	if (this == &rhs) return *this;
 	if (isObject()) {
-		as<Object>()->RefCount--;
+		as<Object>()->Release();
 	}
 	value = rhs.value;
+	rhs.value = NIL_VAL;
 
-	if (isObject()) {
-		as<Object>()->RefCount++;
-	}
 	return *this;
 }
 
@@ -0,0 +1,224 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+/**
+
+Queues used to hand calls to the runners.
+
+MPMCQueue is a bounded multi-producer multi-consumer ring, Vyukov: Bounded MPMC queue.
+Each cell carries a sequence number telling whether it is ready to be written or read, so producers and
+consumers only contend on their own index.
+
+WorkStealingDeque is a Chase-Lev deque, Le et al: Correct and Efficient Work-Stealing for Weak Memory Models.
+The owning runner pushes and takes at the bottom, other runners steal from the top.
+
+EventCount parks idle runners. A waiter reads the epoch, checks for work once more and waits only if the
+epoch has not changed, so a notify between the check and the wait is never lost.
+
+*/
+template <typename T>
+class MPMCQueue
+{
+public:
+	MPMCQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity) size <<= 1;
+		Mask = size - 1;
+		Cells = std::make_unique<Cell[]>(size);
+		for (size_t i = 0; i < size; i++) {
+			Cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+		Enqueue.store(0, std::memory_order_relaxed);
+		Dequeue.store(0, std::memory_order_relaxed);
+	}
+
+	// Returns false if the queue is full
+	bool push(T value) {
+		Cell* cell;
+		size_t pos = Enqueue.load(std::memory_order_relaxed);
+		while (true) {
+			cell = &Cells[pos & Mask];
+			size_t seq = cell->Sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (Enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = Enqueue.load(std::memory_order_relaxed);
+			}
+		}
+		cell->Data = value;
+		cell->Sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false if the queue is empty
+	bool pop(T& value) {
+		Cell* cell;
+		size_t pos = Dequeue.load(std::memory_order_relaxed);
+		while (true) {
+			cell = &Cells[pos & Mask];
+			size_t seq = cell->Sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (Dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = Dequeue.load(std::memory_order_relaxed);
+			}
+		}
+		value = cell->Data;
+		cell->Sequence.store(pos + Mask + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> Sequence;
+		T Data;
+	};
+
+	std::unique_ptr<Cell[]> Cells;
+	size_t Mask;
+	alignas(64) std::atomic<size_t> Enqueue;
+	alignas(64) std::atomic<size_t> Dequeue;
+};
+
+// Values must be trivially copyable, pointers in practice
+template <typename T>
+class WorkStealingDeque
+{
+public:
+	WorkStealingDeque() {
+		Buffers.emplace_back(std::make_unique<Buffer>(64));
+		Array.store(Buffers.back().get(), std::memory_order_relaxed);
+		Top.store(0, std::memory_order_relaxed);
+		Bottom.store(0, std::memory_order_relaxed);
+	}
+
+	// Owner only
+	void push(T value) {
+		int64_t b = Bottom.load(std::memory_order_relaxed);
+		int64_t t = Top.load(std::memory_order_acquire);
+		Buffer* a = Array.load(std::memory_order_relaxed);
+		if (b - t > (int64_t)a->Size - 1) {
+			a = Grow(a, t, b);
+		}
+		a->put(b, value);
+		std::atomic_thread_fence(std::memory_order_release);
+		Bottom.store(b + 1, std::memory_order_relaxed);
+	}
+
+	// Owner only, returns false if the deque is empty
+	bool take(T& value) {
+		int64_t b = Bottom.load(std::memory_order_relaxed) - 1;
+		Buffer* a = Array.load(std::memory_order_relaxed);
+		Bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = Top.load(std::memory_order_relaxed);
+		if (t > b) {
+			Bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		value = a->get(b);
+		if (t == b) {
+			// Last value, race against the thieves
+			bool won = Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			Bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	// Any thread, returns false if the deque is empty or another thread won the race
+	bool steal(T& value) {
+		int64_t t = Top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = Bottom.load(std::memory_order_acquire);
+		if (t >= b) return false;
+		Buffer* a = Array.load(std::memory_order_acquire);
+		value = a->get(t);
+		return Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	bool empty() const {
+		return Bottom.load(std::memory_order_relaxed) <= Top.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Buffer
+	{
+		size_t Size;
+		std::unique_ptr<std::atomic<T>[]> Data;
+
+		Buffer(size_t size) : Size(size), Data(std::make_unique<std::atomic<T>[]>(size)) {}
+		void put(int64_t index, T value) { Data[index & (Size - 1)].store(value, std::memory_order_relaxed); }
+		T get(int64_t index) const { return Data[index & (Size - 1)].load(std::memory_order_relaxed); }
+	};
+
+	// Old buffers are kept until the deque is destroyed, a thief may still be reading them
+	Buffer* Grow(Buffer* old, int64_t t, int64_t b) {
+		Buffers.emplace_back(std::make_unique<Buffer>(old->Size * 2));
+		Buffer* next = Buffers.back().get();
+		for (int64_t i = t; i < b; i++) {
+			next->put(i, old->get(i));
+		}
+		Array.store(next, std::memory_order_release);
+		return next;
+	}
+
+	alignas(64) std::atomic<int64_t> Top;
+	alignas(64) std::atomic<int64_t> Bottom;
+	std::atomic<Buffer*> Array;
+	std::vector<std::unique_ptr<Buffer>> Buffers;
+};
+
+class EventCount
+{
+public:
+	EventCount() : Epoch(0), Waiters(0) {}
+
+	// Call before the last check for work, then either Wait or CancelWait
+	uint32_t PrepareWait() {
+		Waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		return Epoch.load(std::memory_order_seq_cst);
+	}
+
+	void CancelWait() {
+		Waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void Wait(uint32_t key) {
+		Epoch.wait(key, std::memory_order_seq_cst);
+		Waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	// Call after publishing work
+	void Notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (Waiters.load(std::memory_order_relaxed) > 0) {
+			Epoch.fetch_add(1, std::memory_order_seq_cst);
+			Epoch.notify_one();
+		}
+	}
+
+	void NotifyAll() {
+		Epoch.fetch_add(1, std::memory_order_seq_cst);
+		Epoch.notify_all();
+	}
+
+private:
+	std::atomic<uint32_t> Epoch;
+	std::atomic<int> Waiters;
+};